@@ -8,6 +8,9 @@
 #ifndef MODP_B64_
 #define MODP_B64_
 
+#include "cpu.h"
+#include <cstddef>
+#include <cstring>
 #include <stdint.h>
 #include <string>
 
@@ -201,7 +204,7 @@ namespace nm
       /* unsigned here is important! */
       uint8_t t1, t2, t3;
 
-      for(i = 0; i < len - 2; i += 3)
+      for(i = 0; i + 2 < len; i += 3)
       {
         t1 = str[i];
         t2 = str[i + 1];
@@ -263,9 +266,9 @@ namespace nm
 
       uint8_t* p = (uint8_t*)dest;
       uint32_t x = 0;
-      uint32_t* destInt = (uint32_t*)p;
-      uint32_t* srcInt = (uint32_t*)src;
-      uint32_t y = *srcInt++;
+      uint32_t y;
+      ::memcpy(&y, src, sizeof(y));
+      src += sizeof(y);
       for(i = 0; i < chunks; ++i)
       {
         x = ModpHelper::d0[y & 0xff] | ModpHelper::d1[(y >> 8) & 0xff] | ModpHelper::d2[(y >> 16) & 0xff] |
@@ -273,10 +276,10 @@ namespace nm
 
         if(x >= ModpHelper::BADCHAR)
           return -1;
-        *destInt = x;
+        ::memcpy(p, &x, sizeof(x));
         p += 3;
-        destInt = (uint32_t*)p;
-        y = *srcInt++;
+        ::memcpy(&y, src, sizeof(y));
+        src += sizeof(y);
       }
 
       switch(leftover)
@@ -314,25 +317,272 @@ namespace nm
     }
   }
 
+  using base64_encode_fn = size_t (*)(char* dst, const uint8_t* src, size_t n);
+  using base64_decode_fn = ptrdiff_t (*)(uint8_t* dst, const char* src, size_t n);
+
+  // exact size of the encoded text, padding included
+  constexpr size_t base64_encode_size(size_t n) { return ModpHelper::modp_b64_encode_strlen(n); }
+
+  // space base64_decode needs for `n` chars, a bit more than the decoded size
+  constexpr size_t base64_decode_size(size_t n) { return ModpHelper::modp_b64_decode_len(n); }
+
+  inline size_t base64_encode_scalar(char* dst, const uint8_t* src, size_t n)
+  {
+    size_t r = base64_encode_size(n);
+    if(n > 0)
+    {
+      // modp_b64_encode terminates the output, keep the byte after it
+      char last[5];
+      size_t tail = n % 3 == 0 ? 3 : n % 3;
+      ModpHelper::modp_b64_encode(dst, reinterpret_cast<const char*>(src), n - tail);
+      ModpHelper::modp_b64_encode(last, reinterpret_cast<const char*>(src) + n - tail, tail);
+      ::memcpy(dst + r - 4, last, 4);
+    }
+    return r;
+  }
+
+  inline ptrdiff_t base64_decode_scalar(uint8_t* dst, const char* src, size_t n)
+  {
+    return ModpHelper::modp_b64_decode(reinterpret_cast<char*>(dst), src, static_cast<int>(n));
+  }
+
+#ifdef NM_X86
+  // Muła & Lemire, "Faster Base64 Encoding and Decoding Using AVX2 Instructions". each 32 bits lane holds 3 input
+  // bytes in an order that lets two multiplies move the four 6 bits indices to the top of their bytes
+  NM_TARGET("ssse3") inline __m128i base64_split(__m128i in)
+  {
+    in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+    auto t0 = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+    auto t1 = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(t0, t1);
+  }
+
+  // 0..63 to the alphabet, as an offset added to the index
+  NM_TARGET("ssse3") inline __m128i base64_ascii(__m128i idx)
+  {
+    auto r = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+    r = _mm_or_si128(r, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), idx), _mm_set1_epi8(13)));
+    auto shift = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                               '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+    return _mm_add_epi8(_mm_shuffle_epi8(shift, r), idx);
+  }
+
+  // alphabet to 0..63, false if a char is outside the alphabet
+  NM_TARGET("ssse3") inline bool base64_values(__m128i in, __m128i& out)
+  {
+    auto hi = _mm_and_si128(_mm_srli_epi32(in, 4), _mm_set1_epi8(0x0f));
+    auto lo = _mm_and_si128(in, _mm_set1_epi8(0x0f));
+    auto lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b,
+                                0x1b, 0x1a);
+    auto lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                0x10, 0x10);
+    auto lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    auto bad = _mm_and_si128(_mm_shuffle_epi8(lut_lo, lo), _mm_shuffle_epi8(lut_hi, hi));
+    if(_mm_movemask_epi8(_mm_cmpeq_epi8(bad, _mm_setzero_si128())) != 0xffff)
+    {
+      return false;
+    }
+    auto roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(_mm_cmpeq_epi8(in, _mm_set1_epi8(0x2f)), hi));
+    out = _mm_add_epi8(in, roll);
+    return true;
+  }
+
+  // 16 values of 6 bits to 12 bytes in the low part of the result
+  NM_TARGET("ssse3") inline __m128i base64_pack(__m128i v)
+  {
+    auto ab = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+    auto abcd = _mm_madd_epi16(ab, _mm_set1_epi32(0x00011000));
+    return _mm_shuffle_epi8(abcd, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+  }
+
+  NM_TARGET("ssse3") inline size_t base64_encode_ssse3(char* dst, const uint8_t* src, size_t n)
+  {
+    size_t i = 0;
+    char* p = dst;
+    // 12 bytes are used out of every 16 bytes load
+    for(; i + 16 <= n; i += 12, p += 16)
+    {
+      auto in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(p), base64_ascii(base64_split(in)));
+    }
+    return static_cast<size_t>(p - dst) + base64_encode_scalar(p, src + i, n - i);
+  }
+
+  NM_TARGET("ssse3") inline ptrdiff_t base64_decode_ssse3(uint8_t* dst, const char* src, size_t n)
+  {
+    if(n % 4 != 0)
+    {
+      return -1;
+    }
+    size_t i = 0;
+    uint8_t* p = dst;
+    // every store writes 4 bytes past its 12, the last 8 chars (at least 4 bytes) are left to the scalar code
+    for(; i + 24 <= n; i += 16, p += 12)
+    {
+      __m128i v;
+      if(!base64_values(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)), v))
+      {
+        return -1;
+      }
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(p), base64_pack(v));
+    }
+    auto r = base64_decode_scalar(p, src + i, n - i);
+    return r < 0 ? r : (p - dst) + r;
+  }
+
+  NM_TARGET("avx2") inline __m256i base64_split(__m256i in)
+  {
+    auto order = _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1, 10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3,
+                                 4, 1, 2, 0, 1);
+    in = _mm256_shuffle_epi8(in, order);
+    auto t0 = _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+    auto t1 = _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+    return _mm256_or_si256(t0, t1);
+  }
+
+  NM_TARGET("avx2") inline __m256i base64_ascii(__m256i idx)
+  {
+    auto r = _mm256_subs_epu8(idx, _mm256_set1_epi8(51));
+    r = _mm256_or_si256(r, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), idx), _mm256_set1_epi8(13)));
+    auto shift = _mm256_broadcastsi128_si256(_mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                                           '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                                           '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0));
+    return _mm256_add_epi8(_mm256_shuffle_epi8(shift, r), idx);
+  }
+
+  NM_TARGET("avx2") inline bool base64_values(__m256i in, __m256i& out)
+  {
+    auto hi = _mm256_and_si256(_mm256_srli_epi32(in, 4), _mm256_set1_epi8(0x0f));
+    auto lo = _mm256_and_si256(in, _mm256_set1_epi8(0x0f));
+    auto lut_lo = _mm256_broadcastsi128_si256(_mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                                            0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a));
+    auto lut_hi = _mm256_broadcastsi128_si256(_mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10,
+                                                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10));
+    auto lut_roll =
+      _mm256_broadcastsi128_si256(_mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0));
+    auto bad = _mm256_and_si256(_mm256_shuffle_epi8(lut_lo, lo), _mm256_shuffle_epi8(lut_hi, hi));
+    if(!_mm256_testz_si256(bad, bad))
+    {
+      return false;
+    }
+    auto roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(_mm256_cmpeq_epi8(in, _mm256_set1_epi8(0x2f)), hi));
+    out = _mm256_add_epi8(in, roll);
+    return true;
+  }
+
+  // 32 values of 6 bits to 24 contiguous bytes
+  NM_TARGET("avx2") inline __m256i base64_pack(__m256i v)
+  {
+    auto ab = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+    auto abcd = _mm256_madd_epi16(ab, _mm256_set1_epi32(0x00011000));
+    auto order = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1, 2, 1, 0, 6, 5, 4, 10, 9, 8,
+                                  14, 13, 12, -1, -1, -1, -1);
+    return _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(abcd, order), _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+  }
+
+  NM_TARGET("avx2") inline size_t base64_encode_avx2(char* dst, const uint8_t* src, size_t n)
+  {
+    size_t i = 0;
+    char* p = dst;
+    // 12 bytes per lane, the second lane is loaded 12 bytes after the first
+    for(; i + 28 <= n; i += 24, p += 32)
+    {
+      auto in = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i))),
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 12)), 1);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), base64_ascii(base64_split(in)));
+    }
+    return static_cast<size_t>(p - dst) + base64_encode_ssse3(p, src + i, n - i);
+  }
+
+  NM_TARGET("avx2") inline ptrdiff_t base64_decode_avx2(uint8_t* dst, const char* src, size_t n)
+  {
+    if(n % 4 != 0)
+    {
+      return -1;
+    }
+    size_t i = 0;
+    uint8_t* p = dst;
+    // every store writes 8 bytes past its 24, the last 16 chars (at least 10 bytes) are left to the ssse3 code
+    for(; i + 48 <= n; i += 32, p += 24)
+    {
+      __m256i v;
+      if(!base64_values(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i)), v))
+      {
+        return -1;
+      }
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), base64_pack(v));
+    }
+    auto r = base64_decode_ssse3(p, src + i, n - i);
+    return r < 0 ? r : (p - dst) + r;
+  }
+#endif
+
+  inline base64_encode_fn select_base64_encode_kernel()
+  {
+#ifdef NM_X86
+    auto& c = nm::cpu();
+    if(c.avx2)
+    {
+      return base64_encode_avx2;
+    }
+    if(c.ssse3)
+    {
+      return base64_encode_ssse3;
+    }
+#endif
+    return base64_encode_scalar;
+  }
+
+  inline base64_decode_fn select_base64_decode_kernel()
+  {
+#ifdef NM_X86
+    auto& c = nm::cpu();
+    if(c.avx2)
+    {
+      return base64_decode_avx2;
+    }
+    if(c.ssse3)
+    {
+      return base64_decode_ssse3;
+    }
+#endif
+    return base64_decode_scalar;
+  }
+
+  // encode `n` bytes to `dst`, which must hold base64_encode_size(n) chars, the output is not terminated. return
+  // chars written
+  inline size_t base64_encode(char* dst, const void* src, size_t n)
+  {
+    static const base64_encode_fn kernel = select_base64_encode_kernel();
+    return kernel(dst, static_cast<const uint8_t*>(src), n);
+  }
+
+  // decode `n` chars to `dst`, which must hold base64_decode_size(n) bytes. return bytes written, -1 on bad input
+  inline ptrdiff_t base64_decode(void* dst, const char* src, size_t n)
+  {
+    static const base64_decode_fn kernel = select_base64_decode_kernel();
+    return kernel(static_cast<uint8_t*>(dst), src, n);
+  }
+
   inline std::string base64_encode(const std::string& s)
   {
-    std::string x(ModpHelper::modp_b64_encode_len(s.size()), '\0');
-    int d = ModpHelper::modp_b64_encode(const_cast<char*>(x.data()), s.data(), s.size());
-    x.erase(d, std::string::npos);
+    std::string x(base64_encode_size(s.size()), '\0');
+    base64_encode(&x[0], s.data(), s.size());
     return x;
   }
 
   inline std::string base64_decode(const std::string& s)
   {
-    std::string x(ModpHelper::modp_b64_decode_len(s.size()), '\0');
-    int d = ModpHelper::modp_b64_decode(const_cast<char*>(x.data()), s.data(), static_cast<int>(s.size()));
+    std::string x(base64_decode_size(s.size()), '\0');
+    auto d = base64_decode(&x[0], s.data(), s.size());
     if(d < 0)
     {
       x.clear();
     }
     else
     {
-      x.erase(d, std::string::npos);
+      x.erase(static_cast<size_t>(d), std::string::npos);
     }
     return x;
   }
@@ -131,6 +131,9 @@ namespace ws
 
       void write(size_t n) { write_idx_ += n; }
 
+      // drop the last `n` bytes written
+      void unwrite(size_t n) { write_idx_ -= n; }
+
       void set_bytes(size_t n) { bytes_ = n; }
 
       size_t bytes() const { return bytes_; }
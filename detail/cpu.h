@@ -0,0 +1,129 @@
+/*********************************************************
+          File Name: cpu.h
+          Author: Abby Cin
+          Mail: abbytsing@gmail.com
+          Created Time: Sun 18 Oct 2026 10:12:31 AM CST
+**********************************************************/
+
+#ifndef WS_CPU_H
+#define WS_CPU_H
+
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define NM_X86 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#include <immintrin.h>
+#endif
+
+// baseline on x86_64, usable without runtime dispatch
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NM_SSE2 1
+#endif
+
+// enable an instruction set for a single function, so the kernels can be compiled without -mavx2 and friends and
+// selected at runtime
+#if defined(__GNUC__) || defined(__clang__)
+#define NM_TARGET(x) __attribute__((target(x)))
+#else
+#define NM_TARGET(x)
+#endif
+
+namespace nm
+{
+  struct CpuFeatures
+  {
+    bool sse2{false};
+    bool ssse3{false};
+    bool sse41{false};
+    bool avx2{false};
+    bool avx512bw{false};
+    bool sha{false};
+  };
+
+  namespace CpuHelper
+  {
+#ifdef NM_X86
+    inline void cpuid(uint32_t leaf, uint32_t sub, uint32_t (&r)[4])
+    {
+#if defined(_MSC_VER)
+      int tmp[4];
+      __cpuidex(tmp, static_cast<int>(leaf), static_cast<int>(sub));
+      for(int i = 0; i < 4; ++i)
+      {
+        r[i] = static_cast<uint32_t>(tmp[i]);
+      }
+#else
+      __cpuid_count(leaf, sub, r[0], r[1], r[2], r[3]);
+#endif
+    }
+
+    // which register states the OS saves on context switch
+    inline uint64_t xgetbv()
+    {
+#if defined(_MSC_VER)
+      return _xgetbv(0);
+#else
+      uint32_t eax, edx;
+      __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+      return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+    }
+#endif
+
+    inline CpuFeatures detect()
+    {
+      CpuFeatures f{};
+#ifdef NM_X86
+      uint32_t r[4]; // eax, ebx, ecx, edx
+      cpuid(0, 0, r);
+      uint32_t max_leaf = r[0];
+
+      cpuid(1, 0, r);
+      f.sse2 = (r[3] & (1u << 26)) != 0;
+      f.ssse3 = (r[2] & (1u << 9)) != 0;
+      f.sse41 = (r[2] & (1u << 19)) != 0;
+      bool osxsave = (r[2] & (1u << 27)) != 0;
+      bool avx = (r[2] & (1u << 28)) != 0;
+
+      uint64_t xcr0 = osxsave ? xgetbv() : 0;
+      bool ymm = (xcr0 & 0x6u) == 0x6u;    // xmm and ymm state
+      bool zmm = (xcr0 & 0xe6u) == 0xe6u; // plus opmask and zmm state
+
+      if(max_leaf >= 7)
+      {
+        cpuid(7, 0, r);
+        f.avx2 = avx && ymm && (r[1] & (1u << 5)) != 0;
+        f.avx512bw = zmm && (r[1] & (1u << 16)) != 0 && (r[1] & (1u << 30)) != 0; // avx512f and avx512bw
+        f.sha = f.sse41 && (r[1] & (1u << 29)) != 0;
+      }
+#endif
+      return f;
+    }
+  }
+
+  // index of the lowest set bit, `x` must not be 0
+  inline uint32_t ctz(uint32_t x)
+  {
+#if defined(_MSC_VER)
+    unsigned long r;
+    _BitScanForward(&r, x);
+    return static_cast<uint32_t>(r);
+#else
+    return static_cast<uint32_t>(__builtin_ctz(x));
+#endif
+  }
+
+  // detected once, on first use
+  inline const CpuFeatures& cpu()
+  {
+    static const CpuFeatures features = CpuHelper::detect();
+    return features;
+  }
+}
+
+#endif // WS_CPU_H
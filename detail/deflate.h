@@ -0,0 +1,975 @@
+/*********************************************************
+          File Name: deflate.h
+          Author: Abby Cin
+          Mail: abbytsing@gmail.com
+          Created Time: Sun 18 Oct 2026 05:02:17 PM CST
+**********************************************************/
+
+#ifndef WS_DEFLATE_H
+#define WS_DEFLATE_H
+
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <zlib.h>
+
+namespace ws
+{
+  // which outbound messages are worth compressing, decided per message. a message is sent as is when it's smaller
+  // than `min_size`, when a sample of it looks random or when recent messages of its opcode barely shrank
+  struct deflate_policy
+  {
+    bool adaptive = true; // false compresses every message
+    size_t min_size = 64;
+    // order-0 entropy of the sample in bits per byte, compressed or encrypted data is close to 8
+    double max_entropy = 7.5;
+    size_t sample_size = 1024;
+    // compressed / original averaged over recent messages. above it the next `backoff` messages are sent as is, then
+    // one is compressed again to see if the content changed
+    double max_ratio = 0.9;
+    unsigned backoff = 16;
+  };
+
+  // what the policy did and what it cost, for tuning. sizes are payload bytes
+  struct deflate_stats
+  {
+    uint64_t messages = 0;
+    uint64_t compressed = 0;
+    uint64_t skipped_small = 0;
+    uint64_t skipped_entropy = 0;
+    uint64_t skipped_history = 0;
+    uint64_t discarded = 0;   // compressed but not smaller, sent as is
+    uint64_t bytes_in = 0;    // of compressed messages
+    uint64_t bytes_out = 0;   // what they were compressed to
+    uint64_t nanoseconds = 0; // spent compressing, discarded attempts included
+
+    int64_t saved() const { return static_cast<int64_t>(bytes_in) - static_cast<int64_t>(bytes_out); }
+  };
+
+  struct deflate_options
+  {
+    int level = Z_DEFAULT_COMPRESSION;
+    int mem_level = 8;
+    // ask the peer to, or agree to, start every message with an empty window
+    bool server_no_context_takeover = false;
+    bool client_no_context_takeover = false;
+    // LZ77 window of each direction, 9..15. 8 is accepted from a peer but we never deflate with it
+    int server_max_window_bits = 15;
+    int client_max_window_bits = 15;
+    deflate_policy policy{};
+    // with a compress_pool, messages from this size on are split into chunks compressed in parallel
+    size_t parallel_threshold = 1 << 20;
+    size_t chunk_size = 128 << 10;
+  };
+
+  // memory of every compression context kept for the lifetime of a connection, i.e. with context takeover. once it's
+  // used up new connections negotiate no context takeover and borrow contexts from a deflate_pool. thread safe, one
+  // budget is meant to be shared by every pool of a process
+  class deflate_budget
+  {
+  public:
+    explicit deflate_budget(size_t limit) : limit_{limit}, used_{0} {}
+
+    // zlib.h "memory footprint"
+    static size_t deflate_size(int bits, int mem_level)
+    {
+      return (size_t(1) << (bits + 2)) + (size_t(1) << (mem_level + 9)) + 6 * 1024;
+    }
+
+    static size_t inflate_size(int bits) { return (size_t(1) << bits) + 7 * 1024; }
+
+    bool reserve(size_t n)
+    {
+      auto cur = used_.load(std::memory_order_relaxed);
+      do
+      {
+        if(cur + n > limit_)
+        {
+          return false;
+        }
+      } while(!used_.compare_exchange_weak(cur, cur + n, std::memory_order_relaxed));
+      return true;
+    }
+
+    // the peer decided, we can't refuse
+    void force(size_t n) { used_.fetch_add(n, std::memory_order_relaxed); }
+
+    void release(size_t n) { used_.fetch_sub(n, std::memory_order_relaxed); }
+
+    bool available(size_t n) const { return used_.load(std::memory_order_relaxed) + n <= limit_; }
+
+    size_t used() const { return used_.load(std::memory_order_relaxed); }
+
+    size_t limit() const { return limit_; }
+
+  private:
+    const size_t limit_;
+    std::atomic<size_t> used_;
+  };
+
+  namespace detail
+  {
+    struct Deflater
+    {
+      z_stream z{};
+      int level;
+      bool ok;
+
+      Deflater(int lv, int bits, int mem_level) : level{lv}
+      {
+        ok = ::deflateInit2(&z, lv, Z_DEFLATED, -bits, mem_level, Z_DEFAULT_STRATEGY) == Z_OK;
+      }
+
+      ~Deflater()
+      {
+        if(ok)
+        {
+          ::deflateEnd(&z);
+        }
+      }
+
+      Deflater(const Deflater&) = delete;
+
+      Deflater& operator=(const Deflater&) = delete;
+    };
+
+    struct Inflater
+    {
+      z_stream z{};
+      bool ok;
+
+      explicit Inflater(int bits) { ok = ::inflateInit2(&z, -bits) == Z_OK; }
+
+      ~Inflater()
+      {
+        if(ok)
+        {
+          ::inflateEnd(&z);
+        }
+      }
+
+      Inflater(const Inflater&) = delete;
+
+      Inflater& operator=(const Inflater&) = delete;
+    };
+  }
+
+  // contexts lent to a connection for one message, for a direction without context takeover, so 100k connections
+  // cost a handful of windows instead of one each. a message is compressed in one call, the pool never holds more
+  // than a few idle contexts per window size. one pool per io_context, it's not thread safe
+  class deflate_pool
+  {
+  public:
+    explicit deflate_pool(int mem_level = 8, std::shared_ptr<deflate_budget> budget = {})
+        : mem_level_{mem_level}, budget_{std::move(budget)}
+    {
+    }
+
+    deflate_pool(const deflate_pool&) = delete;
+
+    deflate_pool& operator=(const deflate_pool&) = delete;
+
+    const std::shared_ptr<deflate_budget>& budget() const { return budget_; }
+
+    int mem_level() const { return mem_level_; }
+
+    std::unique_ptr<detail::Deflater> get_deflater(int bits, int level)
+    {
+      auto& v = deflaters_[bits];
+      if(v.empty())
+      {
+        return std::unique_ptr<detail::Deflater>{new detail::Deflater{level, bits, mem_level_}};
+      }
+      auto d = std::move(v.back());
+      v.pop_back();
+      return d;
+    }
+
+    void put_deflater(int bits, std::unique_ptr<detail::Deflater> d)
+    {
+      auto& v = deflaters_[bits];
+      if(d->ok && v.size() < kMaxIdle && ::deflateReset(&d->z) == Z_OK)
+      {
+        v.push_back(std::move(d));
+      }
+    }
+
+    std::unique_ptr<detail::Inflater> get_inflater(int bits)
+    {
+      auto& v = inflaters_[bits];
+      if(v.empty())
+      {
+        return std::unique_ptr<detail::Inflater>{new detail::Inflater{bits}};
+      }
+      auto d = std::move(v.back());
+      v.pop_back();
+      return d;
+    }
+
+    void put_inflater(int bits, std::unique_ptr<detail::Inflater> d)
+    {
+      auto& v = inflaters_[bits];
+      if(d->ok && v.size() < kMaxIdle && ::inflateReset(&d->z) == Z_OK)
+      {
+        v.push_back(std::move(d));
+      }
+    }
+
+  private:
+    constexpr static size_t kMaxIdle = 4;
+
+    int mem_level_;
+    std::shared_ptr<deflate_budget> budget_;
+    // indexed by window bits
+    std::vector<std::unique_ptr<detail::Deflater>> deflaters_[16];
+    std::vector<std::unique_ptr<detail::Inflater>> inflaters_[16];
+  };
+
+  // threads compressing large messages away from the io_context threads, shared by any number of streams. it must
+  // outlive them, destroying it finishes the queued work
+  class compress_pool
+  {
+  public:
+    explicit compress_pool(size_t n = std::thread::hardware_concurrency())
+    {
+      for(size_t i = 0; i < std::max<size_t>(n, 1); ++i)
+      {
+        threads_.emplace_back([this] { this->run(); });
+      }
+    }
+
+    ~compress_pool()
+    {
+      {
+        std::lock_guard<std::mutex> lg{mtx_};
+        stop_ = true;
+      }
+      cv_.notify_all();
+      for(auto& t: threads_)
+      {
+        t.join();
+      }
+    }
+
+    compress_pool(const compress_pool&) = delete;
+
+    compress_pool& operator=(const compress_pool&) = delete;
+
+    size_t size() const { return threads_.size(); }
+
+    void post(std::function<void()> f)
+    {
+      {
+        std::lock_guard<std::mutex> lg{mtx_};
+        tasks_.push_back(std::move(f));
+      }
+      cv_.notify_one();
+    }
+
+  private:
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    std::deque<std::function<void()>> tasks_;
+    bool stop_{false};
+    std::vector<std::thread> threads_;
+
+    void run()
+    {
+      for(;;)
+      {
+        std::unique_lock<std::mutex> lk{mtx_};
+        cv_.wait(lk, [this] { return stop_ || !tasks_.empty(); });
+        if(tasks_.empty())
+        {
+          return;
+        }
+        auto f = std::move(tasks_.front());
+        tasks_.pop_front();
+        lk.unlock();
+        f();
+      }
+    }
+  };
+
+  // permessage-deflate, RFC 7692. contexts are created on first use, so a direction that's never used costs nothing.
+  // with a pool a direction without context takeover borrows one per message, and when the pool's budget can't hold
+  // another context for this connection that direction is negotiated without context takeover
+  class permessage_deflate : public extension
+  {
+  public:
+    explicit permessage_deflate(const deflate_options& o = {}, std::shared_ptr<deflate_pool> pool = {})
+        : opt_{o}, pool_{std::move(pool)}
+    {
+    }
+
+    ~permessage_deflate() override
+    {
+      if(reserved_ != 0)
+      {
+        pool_->budget()->release(reserved_);
+      }
+    }
+
+    permessage_deflate(const permessage_deflate&) = delete;
+
+    permessage_deflate& operator=(const permessage_deflate&) = delete;
+
+    // off sends every message uncompressed, the peer is still free to compress
+    void set_compress(bool on) { compress_ = on; }
+
+    bool is_compress_set() const { return compress_; }
+
+    // takes effect from the next message
+    void set_level(int level) { opt_.level = level; }
+
+    int level() const { return opt_.level; }
+
+    // whether messages we send start with an empty window
+    bool is_no_context_takeover() const { return out_no_context_; }
+
+    nm::string_view name() const override { return "permessage-deflate"; }
+
+    uint8_t rsv_bits() const override { return detail::kRsv1; }
+
+    void offer(std::string& params) override
+    {
+      // ask for what the budget can't hold, it's rechecked once the server answered
+      bool server_no_context =
+          opt_.server_no_context_takeover ||
+          !this->affordable(deflate_budget::inflate_size(inflate_bits(opt_.server_max_window_bits)));
+      bool client_no_context = opt_.client_no_context_takeover ||
+                               !this->affordable(deflate_budget::deflate_size(opt_.client_max_window_bits,
+                                                                              opt_.mem_level));
+      if(server_no_context)
+      {
+        params.append("; server_no_context_takeover");
+      }
+      if(client_no_context)
+      {
+        params.append("; client_no_context_takeover");
+      }
+      if(opt_.server_max_window_bits < 15)
+      {
+        params.append("; server_max_window_bits=").append(std::to_string(opt_.server_max_window_bits));
+      }
+      // lets the server shrink our window
+      params.append("; client_max_window_bits");
+      if(opt_.client_max_window_bits < 15)
+      {
+        params.append("=").append(std::to_string(opt_.client_max_window_bits));
+      }
+    }
+
+    bool confirm(const ext_params& params) override
+    {
+      Params p{};
+      if(!parse(params, p) || p.client_bits == 0)
+      {
+        return false;
+      }
+      // resetting our own window is always allowed, a smaller one than asked for too
+      int client_bits = std::min(p.client_bits < 0 ? 15 : p.client_bits, opt_.client_max_window_bits);
+      int server_bits = p.server_bits < 0 ? 15 : p.server_bits;
+      bool client_no_context = p.client_no_context || opt_.client_no_context_takeover ||
+                               !this->reserve(deflate_budget::deflate_size(client_bits, opt_.mem_level), false);
+      if(!p.server_no_context)
+      {
+        this->reserve(deflate_budget::inflate_size(inflate_bits(server_bits)), true);
+      }
+      this->setup(client_no_context, p.server_no_context, client_bits, server_bits);
+      return true;
+    }
+
+    bool accept(const ext_params& params, std::string& response) override
+    {
+      Params p{};
+      if(!parse(params, p))
+      {
+        return false;
+      }
+      int server_bits = std::min(p.server_bits < 0 ? 15 : p.server_bits, opt_.server_max_window_bits);
+      // without client_max_window_bits in the offer the client deflates with 15 bits
+      int client_bits = p.client_bits < 0 ? 15 : std::min(p.client_bits == 0 ? 15 : p.client_bits,
+                                                          opt_.client_max_window_bits);
+      // a server may impose either, so both fall back to no context takeover once the budget is used up
+      bool server_no_context = p.server_no_context || opt_.server_no_context_takeover ||
+                               !this->reserve(deflate_budget::deflate_size(server_bits, opt_.mem_level), false);
+      bool client_no_context = p.client_no_context || opt_.client_no_context_takeover ||
+                               !this->reserve(deflate_budget::inflate_size(inflate_bits(client_bits)), false);
+      if(server_no_context)
+      {
+        response.append("; server_no_context_takeover");
+      }
+      if(client_no_context)
+      {
+        response.append("; client_no_context_takeover");
+      }
+      if(p.server_bits >= 0 || server_bits < 15)
+      {
+        response.append("; server_max_window_bits=").append(std::to_string(server_bits));
+      }
+      if(p.client_bits >= 0 && client_bits < 15)
+      {
+        response.append("; client_max_window_bits=").append(std::to_string(client_bits));
+      }
+      this->setup(server_no_context, client_no_context, server_bits, client_bits);
+      return true;
+    }
+
+    void set_policy(const deflate_policy& p) { opt_.policy = p; }
+
+    const deflate_policy& policy() const { return opt_.policy; }
+
+    const deflate_stats& stats() const { return stats_; }
+
+    uint8_t encode(detail::opcode code, const Buffer& in, detail::Message& out) override
+    {
+      if(!compress_ || out_bits_ < 9 || !this->is_wanted(code, in))
+      {
+        return 0;
+      }
+      auto start = out.readable_size();
+      auto t = std::chrono::steady_clock::now();
+      auto r = this->compress(in, out);
+      stats_.nanoseconds += elapsed(t);
+      if(r == 0 || !this->learn(code, in.readable_size(), out, start))
+      {
+        return 0;
+      }
+      return r;
+    }
+
+    // large messages are compressed on `workers` in chunks of deflate_options::chunk_size
+    void set_workers(std::shared_ptr<compress_pool> workers) { workers_ = std::move(workers); }
+
+    bool is_parallel(size_t n) const override
+    {
+      return workers_ && compress_ && out_bits_ >= 9 && n >= opt_.parallel_threshold;
+    }
+
+    // every chunk is deflated by a fresh context primed with the window before it and ends with a sync flush, so the
+    // concatenation is the stream a single context would have produced, a little larger (as pigz does)
+    void encode_async(detail::opcode code, std::shared_ptr<const std::string> in, EncodeCallback done) override
+    {
+      if(!this->is_wanted(code, buffer(*in)))
+      {
+        done(0, nullptr);
+        return;
+      }
+      auto job = std::make_shared<ParallelJob>();
+      job->code = code;
+      job->level = opt_.level;
+      job->bits = out_bits_;
+      job->mem_level = opt_.mem_level;
+      job->chunk = std::max(opt_.chunk_size, kChunk);
+      job->in = std::move(in);
+      job->done = std::move(done);
+      size_t n = (job->in->size() + job->chunk - 1) / job->chunk;
+      job->parts.resize(n);
+      job->left = n;
+      job_ = job;
+      for(size_t i = 0; i < n; ++i)
+      {
+        workers_->post([this, job, i] { this->compress_chunk(*job, i); });
+      }
+    }
+
+    // the policy, the stats and the window of the next message are only touched on the stream's thread
+    uint8_t encoded_async(uint8_t rsv, detail::Message* out) override
+    {
+      auto job = std::move(job_);
+      if(!job)
+      {
+        return rsv;
+      }
+      stats_.nanoseconds += job->nanoseconds;
+      auto& in = *job->in;
+      if(rsv == 0 || !this->learn(job->code, in.size(), *out, 0))
+      {
+        return 0;
+      }
+      if(!out_no_context_)
+      {
+        // the next message continues from the window of this one
+        if(!def_)
+        {
+          def_.reset(new detail::Deflater{job->level, job->bits, job->mem_level});
+        }
+        size_t w = std::min(in.size(), size_t(1) << job->bits);
+        if(def_->ok && ::deflateReset(&def_->z) == Z_OK)
+        {
+          ::deflateSetDictionary(&def_->z, reinterpret_cast<const Bytef*>(in.data() + in.size() - w),
+                                 static_cast<uInt>(w));
+        }
+      }
+      return rsv;
+    }
+
+    std::error_code decode(const Buffer& in, detail::Message& out, size_t limit) override
+    {
+      if(in_no_context_ && pool_)
+      {
+        auto d = pool_->get_inflater(in_bits_);
+        auto e = d->ok ? this->inflate(*d, in, out, limit) : make_error_code(ws_error::inflate_failed);
+        pool_->put_inflater(in_bits_, std::move(d));
+        return e;
+      }
+      if(!inf_)
+      {
+        inf_.reset(new detail::Inflater{in_bits_});
+      }
+      if(!inf_->ok)
+      {
+        return make_error_code(ws_error::inflate_failed);
+      }
+      auto e = this->inflate(*inf_, in, out, limit);
+      if(e || in_no_context_)
+      {
+        ::inflateReset(&inf_->z);
+      }
+      return e;
+    }
+
+    int64_t encoding_id() const override
+    {
+      if(!compress_ || out_bits_ < 9)
+      {
+        return 0; // nothing is encoded
+      }
+      if(!out_no_context_)
+      {
+        return -1;
+      }
+      int mem_level = pool_ ? pool_->mem_level() : opt_.mem_level;
+      return 1 + (opt_.level + 1) + (out_bits_ << 4) + (mem_level << 8);
+    }
+
+  private:
+    // parameters of an offer or response, -1 for absent, 0 for client_max_window_bits without value
+    struct Params
+    {
+      bool server_no_context = false;
+      bool client_no_context = false;
+      int server_bits = -1;
+      int client_bits = -1;
+    };
+
+    // a message compressed on workers, the last chunk to finish completes it
+    struct ParallelJob
+    {
+      detail::opcode code;
+      int level;
+      int bits;
+      int mem_level;
+      size_t chunk;
+      std::shared_ptr<const std::string> in;
+      EncodeCallback done;
+      std::vector<detail::Message> parts;
+      std::atomic<size_t> left{0};
+      std::atomic<uint64_t> nanoseconds{0};
+      std::atomic<bool> failed{false};
+    };
+
+    // recent outbound messages of an opcode
+    struct History
+    {
+      double ratio = 0; // compressed / original, moving average
+      unsigned skip = 0;
+    };
+
+    constexpr static size_t kTail = 4;
+    constexpr static char kTailBytes[kTail + 1] = "\x00\x00\xff\xff";
+    constexpr static size_t kChunk = 4096;
+    constexpr static int kTooBig = 1 << 16;
+    // zlib deflates with 9 bits when asked for 8, so a peer limited to 8 may still send distances of a 9 bits window
+    constexpr static int kMinInflateBits = 9;
+
+    deflate_options opt_;
+    std::shared_ptr<deflate_pool> pool_;
+    size_t reserved_{0}; // taken from the pool's budget
+    bool compress_{true};
+    bool out_no_context_{false};
+    bool in_no_context_{false};
+    int out_bits_{15};
+    int in_bits_{15}; // the window we inflate with, see kMinInflateBits
+    std::unique_ptr<detail::Deflater> def_;
+    std::unique_ptr<detail::Inflater> inf_;
+    History history_[2]; // text and binary
+    deflate_stats stats_;
+    std::shared_ptr<compress_pool> workers_;
+    std::shared_ptr<ParallelJob> job_; // the message on workers_, until encoded_async()
+
+    bool affordable(size_t n) const { return !pool_ || !pool_->budget() || pool_->budget()->available(n); }
+
+    // true when there's no budget to respect
+    bool reserve(size_t n, bool force)
+    {
+      if(!pool_ || !pool_->budget())
+      {
+        return true;
+      }
+      auto& b = pool_->budget();
+      if(force)
+      {
+        b->force(n);
+      }
+      else if(!b->reserve(n))
+      {
+        return false;
+      }
+      reserved_ += n;
+      return true;
+    }
+
+    static bool parse_bits(const nm::string_view& v, int& bits)
+    {
+      if(v.size() == 1 && v[0] >= '8' && v[0] <= '9')
+      {
+        bits = v[0] - '0';
+        return true;
+      }
+      if(v.size() == 2 && v[0] == '1' && v[1] >= '0' && v[1] <= '5')
+      {
+        bits = 10 + v[1] - '0';
+        return true;
+      }
+      return false;
+    }
+
+    // every parameter at most once, with a valid value
+    static bool parse(const ext_params& params, Params& p)
+    {
+      for(auto& x: params)
+      {
+        if(x.name == "server_no_context_takeover" && !p.server_no_context && x.value.empty())
+        {
+          p.server_no_context = true;
+        }
+        else if(x.name == "client_no_context_takeover" && !p.client_no_context && x.value.empty())
+        {
+          p.client_no_context = true;
+        }
+        else if(x.name == "server_max_window_bits" && p.server_bits < 0)
+        {
+          if(!parse_bits(x.value, p.server_bits))
+          {
+            return false;
+          }
+        }
+        else if(x.name == "client_max_window_bits" && p.client_bits < 0)
+        {
+          p.client_bits = 0;
+          if(!x.value.empty() && !parse_bits(x.value, p.client_bits))
+          {
+            return false;
+          }
+        }
+        else
+        {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    // `out_*` is what we deflate with, `in_*` what the peer does
+    void setup(bool out_no_context, bool in_no_context, int out_bits, int in_bits)
+    {
+      out_no_context_ = out_no_context;
+      in_no_context_ = in_no_context;
+      out_bits_ = out_bits;
+      in_bits_ = inflate_bits(in_bits);
+    }
+
+    // the window we inflate with for a peer allowed `bits`
+    static int inflate_bits(int bits) { return std::max(bits, kMinInflateBits); }
+
+    static uint64_t elapsed(std::chrono::steady_clock::time_point t)
+    {
+      return static_cast<uint64_t>(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t).count());
+    }
+
+    // the policy, false sends the message as is
+    bool is_wanted(detail::opcode code, const Buffer& in)
+    {
+      stats_.messages += 1;
+      auto& p = opt_.policy;
+      if(!p.adaptive)
+      {
+        return true;
+      }
+      auto& h = history_[code == detail::opcode::binary];
+      if(in.readable_size() < p.min_size)
+      {
+        stats_.skipped_small += 1;
+        return false;
+      }
+      if(h.skip > 0)
+      {
+        h.skip -= 1;
+        stats_.skipped_history += 1;
+        return false;
+      }
+      if(entropy(in, p.sample_size) > p.max_entropy)
+      {
+        stats_.skipped_entropy += 1;
+        return false;
+      }
+      return true;
+    }
+
+    // `n` bytes were compressed to what follows `start` in `out`, false when it's dropped to send the message as is
+    bool learn(detail::opcode code, size_t n, detail::Message& out, size_t start)
+    {
+      auto& p = opt_.policy;
+      size_t m = out.readable_size() - start;
+      if(p.adaptive)
+      {
+        auto& h = history_[code == detail::opcode::binary];
+        h.ratio = 0.75 * h.ratio + 0.25 * (n == 0 ? 1.0 : static_cast<double>(m) / static_cast<double>(n));
+        if(h.ratio > p.max_ratio)
+        {
+          h.skip = p.backoff;
+        }
+        // with context takeover the window already holds the message, the peer has to see it compressed
+        if(m >= n && out_no_context_)
+        {
+          out.unwrite(m);
+          stats_.discarded += 1;
+          return false;
+        }
+      }
+      stats_.compressed += 1;
+      stats_.bytes_in += n;
+      stats_.bytes_out += m;
+      return true;
+    }
+
+    // on a worker
+    void compress_chunk(ParallelJob& job, size_t i)
+    {
+      auto t = std::chrono::steady_clock::now();
+      auto& in = *job.in;
+      size_t start = i * job.chunk;
+      size_t n = std::min(job.chunk, in.size() - start);
+      detail::Deflater d{job.level, job.bits, job.mem_level};
+      bool ok = d.ok;
+      if(ok && start > 0)
+      {
+        // the window a single context would have at this point
+        size_t w = std::min(start, size_t(1) << job.bits);
+        ok = ::deflateSetDictionary(&d.z, reinterpret_cast<const Bytef*>(in.data() + start - w),
+                                    static_cast<uInt>(w)) == Z_OK;
+      }
+      if(!ok || !sync_flush(d, job.level, in.data() + start, n, job.parts[i]))
+      {
+        job.failed = true;
+      }
+      job.nanoseconds += elapsed(t);
+      if(job.left.fetch_sub(1) == 1)
+      {
+        finish(job);
+      }
+    }
+
+    // on the worker of the last chunk, the parts are joined and everything else waits for encoded_async()
+    static void finish(ParallelJob& job)
+    {
+      auto done = std::move(job.done);
+      if(job.failed)
+      {
+        done(0, nullptr);
+        return;
+      }
+      size_t size = 0;
+      for(auto& x: job.parts)
+      {
+        size += x.readable_size();
+      }
+      auto out = std::make_shared<detail::Message>(size);
+      for(auto& x: job.parts)
+      {
+        out->append(x.peek(), x.readable_size());
+      }
+      strip_tail(*out, 0);
+      done(detail::kRsv1, out);
+    }
+
+    uint8_t compress(const Buffer& in, detail::Message& out)
+    {
+      if(out_no_context_ && pool_)
+      {
+        auto d = pool_->get_deflater(out_bits_, opt_.level);
+        auto r = d->ok ? this->deflate(*d, in, out) : 0;
+        pool_->put_deflater(out_bits_, std::move(d));
+        return r;
+      }
+      if(!def_)
+      {
+        def_.reset(new detail::Deflater{opt_.level, out_bits_, opt_.mem_level});
+      }
+      if(!def_->ok)
+      {
+        return 0;
+      }
+      auto r = this->deflate(*def_, in, out);
+      if(out_no_context_)
+      {
+        ::deflateReset(&def_->z);
+      }
+      return r;
+    }
+
+    // order-0 entropy in bits per byte of about `n` bytes taken in blocks spread over `in`
+    static double entropy(const Buffer& in, size_t n)
+    {
+      constexpr size_t kBlock = 64;
+      uint32_t count[256] = {};
+      auto data = reinterpret_cast<const unsigned char*>(in.peek());
+      size_t len = in.readable_size();
+      size_t total = len;
+      if(len <= n || len <= kBlock)
+      {
+        for(size_t i = 0; i < len; ++i)
+        {
+          count[data[i]] += 1;
+        }
+      }
+      else
+      {
+        size_t blocks = std::max<size_t>(1, (n + kBlock - 1) / kBlock);
+        size_t stride = (len - kBlock) / blocks;
+        for(size_t b = 0; b < blocks; ++b)
+        {
+          auto p = data + b * stride;
+          for(size_t i = 0; i < kBlock; ++i)
+          {
+            count[p[i]] += 1;
+          }
+        }
+        total = blocks * kBlock;
+      }
+      double e = 0;
+      for(auto c: count)
+      {
+        if(c != 0)
+        {
+          double f = static_cast<double>(c) / static_cast<double>(total);
+          e -= f * std::log2(f);
+        }
+      }
+      return e;
+    }
+
+    // deflate `n` bytes ending on a byte boundary, true on success
+    static bool sync_flush(detail::Deflater& d, int level, const char* data, size_t n, detail::Message& out)
+    {
+      auto& z = d.z;
+      z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+      z.avail_in = static_cast<uInt>(n);
+      out.make_space(::deflateBound(&z, n) + kTail);
+      int r = Z_OK;
+      do
+      {
+        out.make_space(kChunk);
+        z.next_out = reinterpret_cast<Bytef*>(out.begin_write());
+        z.avail_out = static_cast<uInt>(out.writable_size());
+        // the last message was flushed, so changing the level here emits nothing on its own
+        if(d.level != level && ::deflateParams(&z, level, Z_DEFAULT_STRATEGY) == Z_OK)
+        {
+          d.level = level;
+        }
+        r = ::deflate(&z, Z_SYNC_FLUSH);
+        out.write(out.writable_size() - z.avail_out);
+      } while(r == Z_OK && z.avail_out == 0);
+      return r == Z_OK || r == Z_BUF_ERROR;
+    }
+
+    // RFC 7692 7.2.1, drop the 00 00 ff ff of the sync flush
+    static void strip_tail(detail::Message& out, size_t start)
+    {
+      if(out.readable_size() - start >= kTail && ::memcmp(out.begin_write() - kTail, kTailBytes, kTail) == 0)
+      {
+        out.unwrite(kTail);
+      }
+    }
+
+    uint8_t deflate(detail::Deflater& d, const Buffer& in, detail::Message& out)
+    {
+      auto start = out.readable_size();
+      if(!sync_flush(d, opt_.level, in.peek(), in.readable_size(), out))
+      {
+        // the peer never saw this output, start over with an empty window and send the message as is
+        ::deflateReset(&d.z);
+        out.unwrite(out.readable_size() - start);
+        return 0;
+      }
+      strip_tail(out, start);
+      // an empty message after a flush produces nothing, it's sent as an empty stored block (RFC 7692 7.2.3.6)
+      if(out.readable_size() == start)
+      {
+        out.append("", 1);
+      }
+      return detail::kRsv1;
+    }
+
+    std::error_code inflate(detail::Inflater& d, const Buffer& in, detail::Message& out, size_t limit)
+    {
+      auto r = this->inflate(d.z, reinterpret_cast<const Bytef*>(in.peek()), in.readable_size(), out, limit);
+      if(r == Z_OK)
+      {
+        r = this->inflate(d.z, reinterpret_cast<const Bytef*>(kTailBytes), kTail, out, limit);
+      }
+      if(r == Z_STREAM_END)
+      {
+        // the peer ended the deflate stream, the next message starts a new one
+        ::inflateReset(&d.z);
+        return {};
+      }
+      if(r == kTooBig)
+      {
+        return make_error_code(ws_error::payload_too_big);
+      }
+      if(r != Z_OK)
+      {
+        return make_error_code(ws_error::inflate_failed);
+      }
+      return {};
+    }
+
+    int inflate(z_stream& z, const Bytef* data, size_t n, detail::Message& out, size_t limit)
+    {
+      z.next_in = const_cast<Bytef*>(data);
+      z.avail_in = static_cast<uInt>(n);
+      for(;;)
+      {
+        out.make_space(kChunk);
+        z.next_out = reinterpret_cast<Bytef*>(out.begin_write());
+        z.avail_out = static_cast<uInt>(out.writable_size());
+        auto r = ::inflate(&z, Z_SYNC_FLUSH);
+        out.write(out.writable_size() - z.avail_out);
+        if(out.readable_size() > limit)
+        {
+          return kTooBig;
+        }
+        if(r == Z_BUF_ERROR && z.avail_in == 0)
+        {
+          return Z_OK; // everything is consumed and flushed
+        }
+        if(r != Z_OK)
+        {
+          return r;
+        }
+        if(z.avail_in == 0 && z.avail_out != 0)
+        {
+          return Z_OK;
+        }
+      }
+    }
+  };
+}
+
+#endif // WS_DEFLATE_H
@@ -22,7 +22,14 @@ namespace ws
     already_opened,
     unsupport_opcode,
     bad_control_frame,
-    control_message_payload_too_big
+    control_message_payload_too_big,
+    bad_payload,
+    masked_frame,
+    unmasked_frame,
+    inflate_failed,
+    invalid_dictionary,
+    no_message,
+    message_open
   };
 
   class ws_category_impl : public std::error_category
@@ -56,6 +63,20 @@ namespace ws
         return "bad control frame, control frame MUST NOT be fragmented";
       case ws_error::control_message_payload_too_big:
         return "control message payload too big";
+      case ws_error::bad_payload:
+        return "text message is not valid utf-8";
+      case ws_error::masked_frame:
+        return "frame from server must not be masked";
+      case ws_error::unmasked_frame:
+        return "frame from client must be masked";
+      case ws_error::inflate_failed:
+        return "compressed message can't be inflated";
+      case ws_error::invalid_dictionary:
+        return "invalid compression dictionary";
+      case ws_error::no_message:
+        return "no message begun";
+      case ws_error::message_open:
+        return "a message is already open";
       }
 
       return "ok";
@@ -92,7 +113,11 @@ namespace http
     invalid_sec_ws_acc,
     invalid_sec_ws_key,
     invalid_host,
-    invalid_ws_version
+    invalid_ws_version,
+    too_many_fields,
+    line_too_long,
+    invalid_sec_ws_protocol,
+    invalid_sec_ws_ext
   };
 
   class header_error_category : public std::error_category
@@ -126,6 +151,14 @@ namespace http
         return "invalid host";
       case header_error::invalid_ws_version:
         return "sec-websocket-version must be 13";
+      case header_error::too_many_fields:
+        return "too many header fields";
+      case header_error::line_too_long:
+        return "header line too long";
+      case header_error::invalid_sec_ws_protocol:
+        return "sec-websocket-protocol was not offered";
+      case header_error::invalid_sec_ws_ext:
+        return "sec-websocket-extensions was not offered or can't be used";
       }
       return "ok";
     }
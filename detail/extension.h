@@ -0,0 +1,336 @@
+/*********************************************************
+          File Name: extension.h
+          Author: Abby Cin
+          Mail: abbytsing@gmail.com
+          Created Time: Sun 18 Oct 2026 03:12:40 PM CST
+**********************************************************/
+
+#ifndef WS_EXTENSION_H
+#define WS_EXTENSION_H
+
+namespace ws
+{
+  // one `name[=value]` parameter of an extension offer or response
+  struct ext_param
+  {
+    nm::string_view name;
+    nm::string_view value; // unquoted, empty when the parameter has no value
+  };
+
+  using ext_params = std::vector<ext_param>;
+
+  // rsv bits and encoded message of extension::encode_async, rsv 0 sends the message as is
+  using EncodeCallback = std::function<void(uint8_t, std::shared_ptr<detail::Message>)>;
+
+  // an extension negotiated through Sec-WebSocket-Extensions (RFC 6455 9). an instance belongs to one stream and may
+  // keep state across messages, e.g. a compression context
+  class extension
+  {
+  public:
+    virtual ~extension() = default;
+
+    // the extension token, e.g. permessage-deflate
+    virtual nm::string_view name() const = 0;
+
+    // rsv bits (detail::kRsv1..3) set on the first frame of a message the extension transformed
+    virtual uint8_t rsv_bits() const = 0;
+
+    // client, parameters of the offer, each one appended as "; name[=value]"
+    virtual void offer(std::string& params) { (void)params; }
+
+    // client, the server accepted our offer with `params`, false fails the handshake
+    virtual bool confirm(const ext_params& params) = 0;
+
+    // server, a client offer. false declines it, otherwise response parameters are appended as in offer()
+    virtual bool accept(const ext_params& params, std::string& response) = 0;
+
+    // outbound message, the transformed payload goes to `out` and the rsv bits for its first frame are returned.
+    // return 0 to send `in` as is, `out` is ignored then
+    virtual uint8_t encode(detail::opcode code, const Buffer& in, detail::Message& out) = 0;
+
+    // inbound message whose first frame carried our rsv bits, the result goes to `out` and must stay within `limit`
+    virtual std::error_code decode(const Buffer& in, detail::Message& out, size_t limit) = 0;
+
+    // true when a message of `n` bytes should go through encode_async() instead, e.g. so a large one doesn't block
+    // the io_context thread
+    virtual bool is_parallel(size_t n) const
+    {
+      (void)n;
+      return false;
+    }
+
+    // encode() that may complete on another thread. `in` and the extension stay alive until `done` is called and the
+    // stream encodes nothing else meanwhile. `done` may be called on any thread, so state kept across messages is
+    // left to encoded_async()
+    virtual void encode_async(detail::opcode code, std::shared_ptr<const std::string> in, EncodeCallback done)
+    {
+      auto out = std::make_shared<detail::Message>();
+      auto rsv = this->encode(code, buffer(*in), *out);
+      done(rsv, rsv != 0 ? out : nullptr);
+    }
+
+    // back on the stream's thread with what encode_async() passed to `done`, returns the rsv bits to send `out` with,
+    // 0 sends the message as is
+    virtual uint8_t encoded_async(uint8_t rsv, detail::Message* out)
+    {
+      (void)out;
+      return rsv;
+    }
+
+    // non-negative when encode() doesn't depend on earlier messages, the output of two instances with the same id can
+    // be sent by either. a prepared_message is then encoded once for all streams sharing it
+    virtual int64_t encoding_id() const { return -1; }
+  };
+
+  namespace detail
+  {
+    inline nm::string_view unquote(nm::string_view v)
+    {
+      v = v.trim();
+      if(v.size() >= 2 && v[0] == '"' && v[v.size() - 1] == '"')
+      {
+        v = v.substr(1, v.size() - 2);
+      }
+      return v;
+    }
+
+    // `f(name, params)` for every element of a Sec-WebSocket-Extensions value, false when it's malformed
+    template<typename F>
+    bool parse_extensions(nm::string_view v, F&& f)
+    {
+      ext_params params;
+      while(!v.empty())
+      {
+        // a quoted value never contains ',' or ';' in the parameters defined so far, so a plain split is enough
+        auto end = v.find(',');
+        auto item = v.substr(0, end);
+        v = end == v.npos ? nm::string_view{} : v.substr(end + 1, v.size());
+
+        params.clear();
+        auto sep = item.find(';');
+        auto name = item.substr(0, sep).trim();
+        if(name.empty())
+        {
+          if(sep == item.npos && item.trim().empty())
+          {
+            continue; // empty list element
+          }
+          return false;
+        }
+        while(sep != item.npos)
+        {
+          item = item.substr(sep + 1, item.size());
+          sep = item.find(';');
+          auto p = item.substr(0, sep);
+          auto eq = p.find('=');
+          auto key = p.substr(0, eq).trim();
+          if(key.empty())
+          {
+            return false;
+          }
+          params.push_back({key, eq == p.npos ? nm::string_view{} : unquote(p.substr(eq + 1, p.size()))});
+        }
+        if(!f(name, params))
+        {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    // the extensions registered on a stream and the ones in use after the handshake, in the order they are applied
+    // to an outbound message. inbound messages go through them in reverse
+    class ExtensionSet
+    {
+    public:
+      void add(std::shared_ptr<extension> ext) { all_.push_back(std::move(ext)); }
+
+      bool empty() const { return active_.empty(); }
+
+      // rsv bits an inbound frame may carry
+      uint8_t rsv_bits() const { return rsv_; }
+
+      void reset()
+      {
+        active_.clear();
+        rsv_ = 0;
+      }
+
+      // client, the Sec-WebSocket-Extensions value of the upgrade request
+      std::string offer() const
+      {
+        std::string r;
+        for(auto& e: all_)
+        {
+          if(!r.empty())
+          {
+            r.append(", ");
+          }
+          auto name = e->name();
+          r.append(name.data(), name.size());
+          e->offer(r);
+        }
+        return r;
+      }
+
+      // client, the value the server responded with. every extension in it must have been offered, at most once
+      bool confirm(const nm::string_view& v)
+      {
+        this->reset();
+        return parse_extensions(v, [this](const nm::string_view& name, const ext_params& params) {
+          for(auto& e: all_)
+          {
+            if(e->name() == name)
+            {
+              return !this->is_active(*e) && this->claim(*e) && e->confirm(params);
+            }
+          }
+          return false;
+        });
+      }
+
+      // server, pick from the client offers, in its order. the first acceptable offer of an extension wins, the
+      // response value is appended to `response`
+      bool accept(const nm::string_view& v, std::string& response)
+      {
+        this->reset();
+        return parse_extensions(v, [this, &response](const nm::string_view& name, const ext_params& params) {
+          for(auto& e: all_)
+          {
+            if(e->name() != name || this->is_active(*e) || (rsv_ & e->rsv_bits()) != 0)
+            {
+              continue;
+            }
+            std::string tmp;
+            if(e->accept(params, tmp))
+            {
+              if(!response.empty())
+              {
+                response.append(", ");
+              }
+              response.append(name.data(), name.size());
+              response.append(tmp);
+              this->claim(*e);
+            }
+            break;
+          }
+          return true; // unknown or declined offers are ignored
+        });
+      }
+
+      // `in` when no extension transformed it, otherwise a view of `out`. `rsv` gets the bits of the first frame
+      Buffer encode(opcode code, const Buffer& in, Message& out, uint8_t& rsv)
+      {
+        Buffer cur = in;
+        rsv = 0;
+        for(auto& e: active_)
+        {
+          enc_tmp_.reset();
+          auto bits = e->encode(code, cur, enc_tmp_);
+          if(bits != 0)
+          {
+            out.swap(enc_tmp_);
+            cur = buffer(out.peek(), out.readable_size());
+            rsv |= bits;
+          }
+        }
+        return cur;
+      }
+
+      // an inbound message whose first frame carried `rsv`, every extension owning one of the bits decodes it
+      std::error_code decode(uint8_t rsv, const Buffer& in, Message& out, size_t limit, Buffer& res)
+      {
+        res = in;
+        for(auto it = active_.rbegin(); it != active_.rend(); ++it)
+        {
+          auto& e = *it;
+          if((rsv & e->rsv_bits()) == 0)
+          {
+            continue;
+          }
+          tmp_.reset();
+          auto ec = e->decode(res, tmp_, limit);
+          if(ec)
+          {
+            return ec;
+          }
+          out.swap(tmp_);
+          res = buffer(out.peek(), out.readable_size());
+        }
+        return {};
+      }
+
+      // only a single extension in use may encode off the io_context thread
+      bool is_parallel(size_t n) const { return active_.size() == 1 && active_.front()->is_parallel(n); }
+
+      void encode_async(opcode code, std::shared_ptr<const std::string> in, EncodeCallback done)
+      {
+        active_.front()->encode_async(code, std::move(in), std::move(done));
+      }
+
+      uint8_t encoded_async(uint8_t rsv, Message* out) { return active_.front()->encoded_async(rsv, out); }
+
+      // identifies the encoding of the extensions in use, false when any of them keeps state across messages
+      bool encoding_key(std::string& key) const
+      {
+        key.clear();
+        for(auto& e: active_)
+        {
+          auto id = e->encoding_id();
+          if(id < 0)
+          {
+            return false;
+          }
+          auto name = e->name();
+          key.append(name.data(), name.size()).append("=").append(std::to_string(id)).append(";");
+        }
+        return true;
+      }
+
+    private:
+      std::vector<std::shared_ptr<extension>> all_;
+      std::vector<extension*> active_;
+      uint8_t rsv_{0};
+      Message tmp_;     // decode() only, a message read may still be viewed while others are encoded
+      Message enc_tmp_; // encode() only
+
+      bool is_active(const extension& e) const
+      {
+        return std::find(active_.begin(), active_.end(), &e) != active_.end();
+      }
+
+      // two extensions in use can't share a rsv bit
+      bool claim(extension& e)
+      {
+        if(rsv_ & e.rsv_bits())
+        {
+          return false;
+        }
+        rsv_ |= e.rsv_bits();
+        active_.push_back(&e);
+        return true;
+      }
+    };
+
+    // server, the first subprotocol of the client list that we support, empty when there is none
+    inline nm::string_view select_subprotocol(nm::string_view offered, const std::vector<std::string>& supported)
+    {
+      while(!offered.empty())
+      {
+        auto end = offered.find(',');
+        auto p = offered.substr(0, end).trim();
+        offered = end == offered.npos ? nm::string_view{} : offered.substr(end + 1, offered.size());
+        for(auto& s: supported)
+        {
+          if(p == nm::string_view{s})
+          {
+            return p;
+          }
+        }
+      }
+      return {};
+    }
+  }
+}
+
+#endif // WS_EXTENSION_H
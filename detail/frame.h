@@ -9,31 +9,56 @@
 #define FRAME_H_
 
 #include "error.h"
+#include "mask.h"
 
 namespace ws
 {
   namespace detail
   {
+    inline uint16_t byte_swap(uint16_t x)
+    {
+#if defined(_MSC_VER)
+      return _byteswap_ushort(x);
+#else
+      return __builtin_bswap16(x);
+#endif
+    }
+
+    inline uint32_t byte_swap(uint32_t x)
+    {
+#if defined(_MSC_VER)
+      return _byteswap_ulong(x);
+#else
+      return __builtin_bswap32(x);
+#endif
+    }
+
+    inline uint64_t byte_swap(uint64_t x)
+    {
+#if defined(_MSC_VER)
+      return _byteswap_uint64(x);
+#else
+      return __builtin_bswap64(x);
+#endif
+    }
+
     // network byte order to host byte order and viceversa
-    // we can't using alias in C++11
     template<typename T>
     T translate(T value)
     {
-      uint16_t x = 1;
-      if(*(uint8_t*)&x == 0)
-      {
-        return value; // big endian
-      }
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+      return value;
+#else
+      return byte_swap(value);
+#endif
+    }
 
-      T res;
-      char* p = (char*)&value - 1;
-      char* e = p + sizeof(T);
-      char* r = (char*)&res + sizeof(T);
-      while(p != e)
-      {
-        *--r = *++p;
-      }
-      return res;
+    template<typename T>
+    T load_network(const uint8_t* p)
+    {
+      T x;
+      std::memcpy(&x, p, sizeof(x));
+      return translate<T>(x);
     }
 
     /*
@@ -93,23 +118,10 @@ namespace ws
       try_again_later = 1013,
     };
 
-    // mask/unmask are the same
-    inline void mask(char* data, size_t n, uint32_t mask_key)
-    {
-      constexpr auto width = sizeof(uint32_t);
-      auto q = n / width;
-      auto p1 = (uint32_t*)data;
-      for(size_t i = 0; i < q; ++i)
-      {
-        p1[i] ^= mask_key;
-      }
-      auto key = (uint8_t*)&mask_key;
-      auto p2 = (uint8_t*)data;
-      for(size_t i = q * width; i < n; ++i)
-      {
-        p2[i] ^= key[i & 3u];
-      }
-    }
+    // rsv bits of the first header byte, an extension negotiated in the handshake may claim them
+    constexpr uint8_t kRsv1 = 0x40u;
+    constexpr uint8_t kRsv2 = 0x20u;
+    constexpr uint8_t kRsv3 = 0x10u;
 
     inline size_t build_close_msg(char* payload, close_code c, const char* data, size_t n)
     {
@@ -134,131 +146,230 @@ namespace ws
       return {};
     }
 
-    class WsFrame
+    // a frame whose header has been decoded, payload is at `offset + header` of the parsed region
+    struct FrameDesc
     {
-    public:
-      WsFrame() : fin_{0x0u}, opcode_{opcode::close}, mask_key_{0}, frame_len_{0}, payload_len_{0} {}
+      uint64_t offset;
+      uint64_t length;
+      uint32_t mask_key;
+      uint8_t header; // 0: header is incomplete
+      uint8_t rsv;
+      opcode code;
+      bool fin;
+      bool mask;
+    };
 
-      std::error_code parse_frame(char* data, size_t n)
+    // decode the frame header at `p`, `d.header` is 0 when fewer than a whole header is available. rsv bits outside
+    // `rsv_allowed` are an error
+    inline std::error_code decode_frame_header(const uint8_t* p, size_t n, FrameDesc& d, uint8_t rsv_allowed = 0)
+    {
+      d.header = 0;
+      if(n < 2)
       {
-        complete_ = false;
-        // at least 2 bytes
-        if(n < 2)
-        {
-          return {};
-        }
+        return {};
+      }
 
-        auto* rd = (uint8_t*)data;
-        uint8_t* end = rd + n;
+      uint8_t b0 = p[0];
+      uint8_t b1 = p[1];
+      uint8_t rsv = b0 & 0x70u;
+      if(rsv & ~rsv_allowed)
+      {
+        return make_error_code(ws_error::bad_frame); // rsv1-3
+      }
 
-        // get fin, rsv1-3 and opcode
-        fin_ = *rd & 0xf0u;
-        if(fin_ != 0x80u && fin_ != 0x0u)
-        {
-          return make_error_code(ws_error::bad_frame);
-        }
+      // cont, text, binary, close, ping and pong
+      uint8_t code = b0 & 0xfu;
+      if(((0x0707u >> code) & 1u) == 0)
+      {
+        return make_error_code(ws_error::unsupport_opcode);
+      }
 
-        switch(static_cast<uint8_t>(*rd & 0xfu))
-        {
-        case 0:
-          opcode_ = opcode::cont;
-          break;
-        case 1:
-          opcode_ = opcode::text;
-          break;
-        case 2:
-          opcode_ = opcode::binary;
-          break;
-        case 8:
-          opcode_ = opcode::close;
-          break;
-        case 9:
-          opcode_ = opcode::ping;
-          break;
-        case 10:
-          opcode_ = opcode::pong;
-          break;
-        default:
-          return make_error_code(ws_error::unsupport_opcode);
-        }
+      bool fin = (b0 & 0x80u) != 0;
+      bool control = (code & 0x8u) != 0;
+      if(control && (!fin || rsv != 0))
+      {
+        return make_error_code(ws_error::bad_control_frame);
+      }
 
-        if(!is_fin() && is_control())
-        {
-          return make_error_code(ws_error::bad_control_frame);
-        }
+      uint8_t len = b1 & 0x7fu;
+      if(control && len > 0x7d)
+      {
+        return make_error_code(ws_error::control_message_payload_too_big);
+      }
 
-        rd += 1;
-        if(rd >= end)
-        {
-          return {};
-        }
+      bool mask = (b1 & 0x80u) != 0;
+      size_t ext = len < 0x7e ? 0 : (len == 0x7e ? sizeof(uint16_t) : sizeof(uint64_t));
+      size_t header = 2 + ext + (mask ? sizeof(uint32_t) : 0);
+      if(n < header)
+      {
+        return {};
+      }
 
-        mask_ = false;
-        if(*rd & 0x80u)
-        {
-          mask_ = true;
-        }
-        unsigned int len = *rd & ~0x80u;
-        rd += 1;
+      uint64_t length = len;
+      if(ext == sizeof(uint16_t))
+      {
+        length = load_network<uint16_t>(p + 2);
+      }
+      else if(ext == sizeof(uint64_t))
+      {
+        length = load_network<uint64_t>(p + 2);
+      }
 
-        if(len < 0x7e)
-        {
-          payload_len_ = len;
-        }
-        else if(len == 0x7e)
+      d.mask_key = 0;
+      if(mask)
+      {
+        std::memcpy(&d.mask_key, p + 2 + ext, sizeof(d.mask_key));
+      }
+      d.length = length;
+      d.rsv = rsv;
+      d.code = static_cast<opcode>(code);
+      d.fin = fin;
+      d.mask = mask;
+      d.header = static_cast<uint8_t>(header);
+      return {};
+    }
+
+    // index every complete frame of a region at once, so a read bringing in many small frames decodes them in one
+    // tight loop instead of one parse per read_impl iteration
+    class FrameIndex
+    {
+    public:
+      constexpr static size_t kCapacity = 64;
+
+      FrameIndex() : cur_{0}, count_{0}, frames_{} {}
+
+      // returns the error of the first frame that can't be indexed, frames before it are still usable
+      std::error_code build(const char* data, size_t n, uint8_t rsv_allowed = 0)
+      {
+        cur_ = 0;
+        count_ = 0;
+        auto p = reinterpret_cast<const uint8_t*>(data);
+        size_t off = 0;
+        std::error_code e{};
+        while(count_ < kCapacity)
         {
-          if(rd + 2 > end)
+          auto& d = frames_[count_];
+          e = decode_frame_header(p + off, n - off, d, rsv_allowed);
+          if(e || d.header == 0 || n - off - d.header < d.length)
           {
-            return {};
+            break;
           }
-
-          uint16_t x = *(uint16_t*)rd;
-          // real payload length
-          payload_len_ = translate<uint16_t>(x);
-          rd += 2;
+          d.offset = off;
+          off += d.header + d.length;
+          count_ += 1;
         }
-        else if(len == 0x7fu)
+        return e;
+      }
+
+      bool empty() const { return cur_ == count_; }
+
+      const FrameDesc& front() const { return frames_[cur_]; }
+
+      void pop() { cur_ += 1; }
+
+      void clear()
+      {
+        cur_ = 0;
+        count_ = 0;
+      }
+
+    private:
+      size_t cur_;
+      size_t count_;
+      FrameDesc frames_[kCapacity];
+    };
+
+    // xorshift128+ seeded from std::random_device, one state per thread so client threads never share (or race on)
+    // the same sequence. keys are generated in batches, a frame only pays for one load
+    class MaskKeyGenerator
+    {
+    public:
+      constexpr static size_t kBatch = 64;
+
+      static MaskKeyGenerator& local()
+      {
+        static thread_local MaskKeyGenerator gen{};
+        return gen;
+      }
+
+      uint32_t next()
+      {
+        if(idx_ == kBatch)
         {
-          if(rd + 8 > end)
-          {
-            return {};
-          }
-          uint64_t x = *(uint64_t*)rd;
-          payload_len_ = translate<uint64_t>(x);
-          rd += 8;
+          this->refill();
         }
-        else
+        return keys_[idx_++];
+      }
+
+    private:
+      size_t idx_;
+      uint64_t s0_;
+      uint64_t s1_;
+      uint32_t keys_[kBatch];
+
+      MaskKeyGenerator() : idx_{kBatch}, s0_{0}, s1_{0}
+      {
+        std::random_device rd;
+        while(s0_ == 0 && s1_ == 0)
         {
-          return make_error_code(ws_error::invalid_frame_length);
+          s0_ = (static_cast<uint64_t>(rd()) << 32u) | rd();
+          s1_ = (static_cast<uint64_t>(rd()) << 32u) | rd();
         }
+      }
 
-        if(is_control() && payload_size() > 0x7d)
+      void refill()
+      {
+        uint64_t x = s0_;
+        uint64_t y = s1_;
+        for(size_t i = 0; i < kBatch; i += 2)
         {
-          return make_error_code(ws_error::control_message_payload_too_big);
+          x ^= x << 23u;
+          x ^= x >> 17u;
+          x ^= y ^ (y >> 26u);
+          std::swap(x, y);
+          uint64_t r = x + y;
+          keys_[i] = static_cast<uint32_t>(r);
+          keys_[i + 1] = static_cast<uint32_t>(r >> 32u);
         }
+        s0_ = x;
+        s1_ = y;
+        idx_ = 0;
+      }
+    };
 
-        if(mask_)
+    class WsFrame
+    {
+    public:
+      WsFrame() : fin_{0x0u}, opcode_{opcode::close}, mask_key_{0}, frame_len_{0}, payload_len_{0} {}
+
+      std::error_code parse_frame(char* data, size_t n, uint8_t rsv_allowed = 0)
+      {
+        complete_ = false;
+        FrameDesc d{};
+        auto e = decode_frame_header(reinterpret_cast<const uint8_t*>(data), n, d, rsv_allowed);
+        if(!e && d.header != 0)
         {
-          // get mask key
-          if(rd + 4 > end)
-          {
-            return {};
-          }
-          else
-          {
-            mask_key_ = *(uint32_t*)rd;
-            rd += 4;
-          }
+          this->assign(d);
         }
-        frame_len_ = static_cast<uint32_t>(rd - (uint8_t*)data);
+        return e;
+      }
+
+      void assign(const FrameDesc& d)
+      {
+        fin_ = d.fin ? 0x80u : 0x0u;
+        rsv_ = d.rsv;
+        opcode_ = d.code;
+        mask_ = d.mask;
+        mask_key_ = d.mask_key;
+        frame_len_ = d.header;
+        payload_len_ = d.length;
         complete_ = true;
-        return {};
       }
 
       size_t build(char* data)
       {
         auto* p = (uint8_t*)data;
-        *p = fin_ | static_cast<uint8_t>(opcode_);
+        *p = fin_ | rsv_ | static_cast<uint8_t>(opcode_);
 
         p += 1;
 
@@ -304,6 +415,10 @@ namespace ws
 
       void unset_fin() { fin_ = 0x0u; }
 
+      void set_rsv(uint8_t rsv) { rsv_ = rsv & 0x70u; }
+
+      uint8_t rsv() { return rsv_; }
+
       void set_mask(bool off)
       {
         mask_ = off;
@@ -352,6 +467,7 @@ namespace ws
       void clear()
       {
         fin_ = 0x0u;
+        rsv_ = 0x0u;
         opcode_ = opcode::cont;
         mask_key_ = 0;
         frame_len_ = 0;
@@ -363,33 +479,13 @@ namespace ws
       bool mask_{false};
       bool complete_{false};
       uint8_t fin_;
+      uint8_t rsv_{0x0u};
       opcode opcode_;
       uint32_t mask_key_;
       uint32_t frame_len_;
       uint64_t payload_len_;
 
-      uint32_t gen_mask_key()
-      {
-#if 0
-        static std::random_device rd;
-        std::mt19937 eng{rd()};
-        return eng();
-#else
-        static unsigned long x = 123456789, y = 362436069, z = 521288629;
-
-        unsigned long t;
-        x ^= x << 16u;
-        x ^= x >> 5u;
-        x ^= x << 1u;
-
-        t = x;
-        x = y;
-        y = z;
-        z = t ^ x ^ y;
-
-        return z;
-#endif
-      }
+      uint32_t gen_mask_key() { return MaskKeyGenerator::local().next(); }
     };
   }
   using close_code = detail::close_code;
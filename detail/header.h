@@ -17,7 +17,14 @@ namespace http
   class header
   {
   public:
-    static header_error parse_accept_header(header& h, char* data, size_t n)
+    constexpr static size_t kMaxFields = 32;
+
+    // the longest request, status or field line accepted
+    constexpr static size_t kMaxLineSize = 8192;
+
+    // a header may arrive in any number of pieces, every call resumes where the last one returned `more`. `data`
+    // must be the same buffer each time, grown at its end
+    static header_error parse_accept_header(header& h, const char* data, size_t n)
     {
       static nm::string_view prefix{"HTTP/1.1"};
       nm::string_view v{data, n};
@@ -26,59 +33,18 @@ namespace http
         return header_error::invalid_status_line;
       }
 
-      auto end = v.find(CRLFs);
-      if(end == v.npos)
-      {
-        return header_error::more;
-      }
-      h.set_size(end + 4); // including CRLFs
-
-      auto index = v.find_first_of(CRLF);
-      auto line = v.substr(0, index).trim();
-
-      // parse status line
-      {
-        line = line.substr(prefix.size(), line.size()).trim();
-        auto idx = line.find(' ');
-        if(idx == line.npos)
-        {
-          return header_error::invalid_status_line;
-        }
-
-        auto code = line.substr(0, idx).trim();
-
-        h.set_code(code);
-        if(code != "101")
-        {
-          return header_error::invalid_status_line;
-        }
-      }
-
-      auto old = index;
-      while(index < end)
+      auto r = h.parse(data, n, false);
+      if(r != header_error::ok)
       {
-        old = index + 2;
-        index = v.find_first_of(CRLF, old);
-        line = v.substr(old, index - old);
-        auto sep = line.find(':');
-        if(sep == line.npos)
-        {
-          return header_error::invalid_field_format;
-        }
-        to_lower(data + old, sep);
-        auto key = line.substr(0, sep).trim();
-        auto val = line.substr(sep + 1, index - sep).trim();
-        h.header_.emplace(key, val);
+        return r;
       }
 
-      if(h.field("upgrade") != "websocket")
+      if(!iequals(h.field("upgrade"), "websocket"))
       {
         return header_error::invalid_upgrade;
       }
 
-      auto connection = h.field("connection").to_string();
-      std::transform(connection.begin(), connection.end(), connection.begin(), [](auto c) { return std::tolower(c); });
-      if(connection.find("upgrade") == connection.npos)
+      if(!contains_token(h.field("connection"), "upgrade"))
       {
         return header_error::invalid_connection;
       }
@@ -89,16 +55,16 @@ namespace http
         return header_error::invalid_sec_ws_acc;
       }
 
-      auto key = h.field("sec-websocket-key");
-      if(!ws_verify_key(key, accept_key))
+      if(!ws_verify_key(nm::string_view{h.key_, kKeySize}, accept_key))
       {
         return header_error::invalid_sec_ws_key;
       }
-      // TODO: handle optional Sec-Websocket-Extensions, Sec-Websocket-Protocol
+      // sec-websocket-protocol and sec-websocket-extensions are checked by the stream against what it offered
       return header_error::ok;
     }
 
-    static header_error parse_upgrade_header(header& h, char* data, size_t n)
+    // resumable as parse_accept_header
+    static header_error parse_upgrade_header(header& h, const char* data, size_t n)
     {
       static nm::string_view prefix{"GET"};
       nm::string_view v{data, n};
@@ -106,50 +72,11 @@ namespace http
       {
         return header_error::invalid_status_line;
       }
-      auto end = v.find(CRLFs);
-      if(end == v.npos)
-      {
-        return header_error::more;
-      }
-      h.set_size(end + 4); // including CRLFs
-
-      auto index = v.find_first_of(CRLF);
-      auto line = v.substr(0, index).trim();
 
-      // parse status line
+      auto r = h.parse(data, n, true);
+      if(r != header_error::ok)
       {
-        auto idx = line.rfind("HTTP/");
-        if(idx == line.npos)
-        {
-          return header_error::invalid_status_line;
-        }
-
-        auto ver = line.substr(idx + 5, line.size()).trim();
-        if(ver != "1.1")
-        {
-          return header_error::invalid_status_line;
-        }
-
-        auto path = line.substr(0, idx).remove_prefix(prefix.size()).trim();
-        h.set_version(ver);
-        h.set_path(path);
-      }
-
-      auto old = index;
-      while(index < end)
-      {
-        old = index + 2;
-        index = v.find_first_of(CRLF, old);
-        line = v.substr(old, index - old);
-        auto sep = line.find(':');
-        if(sep == line.npos)
-        {
-          return header_error::invalid_field_format;
-        }
-        to_lower(data + old, sep);
-        auto key = line.substr(0, sep).trim();
-        auto val = line.substr(sep + 1, index - sep).trim();
-        h.header_.emplace(key, val);
+        return r;
       }
 
       if(h.field("host").empty())
@@ -157,14 +84,12 @@ namespace http
         return header_error::invalid_host;
       }
 
-      if(h.field("upgrade") != "websocket")
+      if(!iequals(h.field("upgrade"), "websocket"))
       {
         return header_error::invalid_upgrade;
       }
 
-      auto connection = h.field("connection").to_string();
-      std::transform(connection.begin(), connection.end(), connection.begin(), [](auto c) { return std::tolower(c); });
-      if(connection.find("upgrade") == connection.npos)
+      if(!contains_token(h.field("connection"), "upgrade"))
       {
         return header_error::invalid_connection;
       }
@@ -204,46 +129,76 @@ namespace http
       {
         throw std::runtime_error("invalid host, must be ws:// or wss://");
       }
+      h.ws_gen_key();
       h.set("host", v);
       h.set("upgrade", "websocket");
       h.set("connection", "Upgrade");
-      h.set("sec-websocket-key", ws_gen_key().data());
+      h.set("sec-websocket-key", nm::string_view{h.key_, kKeySize});
       h.set("sec-websocket-version", "13");
       return h;
     }
 
-    static std::string build_accept_header(header& src)
+    // ws_gen_accept_key output, base64 of a sha1 digest
+    constexpr static size_t kAcceptKeySize = nm::base64_encode_size(nm::Sha1::DIGEST_SIZE);
+
+    constexpr static char kAcceptHeaderHead[] = "HTTP/1.1 101 Switching Protocols\r\n"
+                                                "upgrade:websocket\r\n"
+                                                "connection:Upgrade\r\n"
+                                                "sec-websocket-accept:";
+
+    constexpr static size_t kAcceptHeaderSize = sizeof(kAcceptHeaderHead) - 1 + kAcceptKeySize + sizeof(CRLFs) - 1;
+
+    constexpr static char kAcceptProtocol[] = "sec-websocket-protocol:";
+    constexpr static char kAcceptExtensions[] = "sec-websocket-extensions:";
+
+    // bytes of the 101 response with the negotiated `protocol` and `extensions`, an empty one is left out
+    static size_t accept_header_size(const nm::string_view& protocol = {}, const nm::string_view& extensions = {})
     {
-      auto key = src.field("sec-websocket-key");
-      header h{};
-      h.set_role(false);
-      h.set_version("1.1");
-      h.set_code("101");
-      h.set("upgrade", "websocket");
-      h.set("connection", "Upgrade");
-      h.set("sec-websocket-accept", ws_gen_accept_key(key).data());
+      auto n = kAcceptHeaderSize;
+      if(!protocol.empty())
+      {
+        n += sizeof(kAcceptProtocol) - 1 + protocol.size() + sizeof(CRLF) - 1;
+      }
+      if(!extensions.empty())
+      {
+        n += sizeof(kAcceptExtensions) - 1 + extensions.size() + sizeof(CRLF) - 1;
+      }
+      return n;
+    }
 
-      return h.build();
+    // write the 101 response to `src` into `out`, which must hold accept_header_size(protocol, extensions) bytes,
+    // return bytes written
+    static size_t build_accept_header(header& src, char* out, const nm::string_view& protocol = {},
+                                      const nm::string_view& extensions = {})
+    {
+      auto p = out;
+      ::memcpy(p, kAcceptHeaderHead, sizeof(kAcceptHeaderHead) - 1);
+      p += sizeof(kAcceptHeaderHead) - 1;
+      ws_gen_accept_key(src.field("sec-websocket-key"), p);
+      p += kAcceptKeySize;
+      ::memcpy(p, CRLF, sizeof(CRLF) - 1);
+      p += sizeof(CRLF) - 1;
+      if(!protocol.empty())
+      {
+        p = put_field(p, kAcceptProtocol, sizeof(kAcceptProtocol) - 1, protocol);
+      }
+      if(!extensions.empty())
+      {
+        p = put_field(p, kAcceptExtensions, sizeof(kAcceptExtensions) - 1, extensions);
+      }
+      ::memcpy(p, CRLF, sizeof(CRLF) - 1);
+      return accept_header_size(protocol, extensions);
     }
 
     header() = default;
 
-    header(header&& h) noexcept
-        : is_client_{h.is_client_}, method_{h.method_}, code_{h.code_}, path_{h.path_}, version_{h.version_},
-          header_{std::move(h.header_)}
-    {
-    }
+    header(header&& h) noexcept { this->assign(h); }
 
     header& operator=(header&& h) noexcept
     {
       if(this != &h)
       {
-        is_client_ = h.is_client_;
-        method_ = h.method_;
-        code_ = h.code_;
-        path_ = h.path_;
-        version_ = h.version_;
-        header_ = std::move(h.header_);
+        this->assign(h);
       }
       return *this;
     }
@@ -260,11 +215,11 @@ namespace http
         res.append("HTTP/1.1 101 Switching Protocol");
         res.append(CRLF);
       }
-      for(auto& iter: header_)
+      for(size_t i = 0; i < nfields_; ++i)
       {
-        res.append(iter.first.to_string());
+        res.append(fields_[i].key.data(), fields_[i].key.size());
         res.append(":");
-        res.append(iter.second.to_string());
+        res.append(fields_[i].value.data(), fields_[i].value.size());
         res.append(CRLF);
       }
       res.append(CRLF);
@@ -277,76 +232,495 @@ namespace http
 
     void set_version(const nm::string_view& v) { version_ = v; }
 
-    void set(const nm::string_view& key, const nm::string_view& value) { header_.emplace(key, value); }
+    // a repeated field is kept, but field() returns the first one, except for sec-websocket-protocol and
+    // sec-websocket-extensions, whose lines are one comma separated list. false when the table is full
+    bool set(const nm::string_view& key, const nm::string_view& value)
+    {
+      if(nfields_ == kMaxFields)
+      {
+        return false;
+      }
+      auto k = known_slot(key);
+      if(k != kUnknown && known_[k] == 0)
+      {
+        known_[k] = static_cast<uint8_t>(nfields_ + 1);
+      }
+      else if(k == kSecProtocol || k == kSecExtensions)
+      {
+        this->join(k, value);
+      }
+      fields_[nfields_].key = key;
+      fields_[nfields_].value = value;
+      nfields_ += 1;
+      return true;
+    }
 
     void set_path(const nm::string_view& path) { path_ = path; }
 
     void set_code(const nm::string_view& code) { code_ = code; }
 
+    // `key` is matched ignoring case
     const nm::string_view& field(const nm::string_view& key)
     {
       static nm::string_view empty;
-      auto iter = header_.find(key);
-      if(iter == header_.end())
+      auto k = known_slot(key);
+      if((k == kSecProtocol || k == kSecExtensions) && !joined_[k - kSecProtocol].empty())
+      {
+        return joined_[k - kSecProtocol];
+      }
+      if(k != kUnknown)
+      {
+        return known_[k] == 0 ? empty : fields_[known_[k] - 1].value;
+      }
+      for(size_t i = 0; i < nfields_; ++i)
       {
-        return empty;
+        if(iequals(fields_[i].key, key))
+        {
+          return fields_[i].value;
+        }
       }
-      return iter->second;
+      return empty;
     }
 
     nm::string_view& path() { return path_; }
 
+    // start over, the next parse_*_header call begins with a new status line
+    void reset_parser()
+    {
+      state_ = kStatusLine;
+      pos_ = 0;
+      sep_ = 0;
+      scan_ = 0;
+    }
+
   private:
+    struct Field
+    {
+      nm::string_view key;
+      nm::string_view value;
+    };
+
+    // the headers a handshake looks up, resolved to a slot without comparing against every field
+    enum Known : uint8_t
+    {
+      kHost,
+      kOrigin,
+      kUpgrade,
+      kConnection,
+      kSecKey,
+      kSecAccept,
+      kSecVersion,
+      kSecProtocol,
+      kSecExtensions,
+      kKnownCount,
+      kUnknown = 0xff
+    };
+
+    enum State : uint8_t
+    {
+      kStatusLine,
+      kLineStart,
+      kFieldName,
+      kFieldValue,
+      kDone
+    };
+
+    // the length of the client key, base64 of 16 bytes nonce
+    constexpr static size_t kKeySize = nm::base64_encode_size(16);
+
     bool is_client_{false};
     size_t size_{};
     nm::string_view method_{};
     nm::string_view code_{};
     nm::string_view path_{};
     nm::string_view version_{};
-    using header_t = std::map<nm::string_view, nm::string_view>;
-    header_t header_{};
+    Field fields_[kMaxFields]{};
+    size_t nfields_{0};
+    uint8_t known_[kKnownCount]{}; // index + 1 into fields_, 0 when absent
+    std::string lists_[2];         // sec-websocket-protocol and -extensions split over several lines
+    nm::string_view joined_[2];    // views of them, empty when the field came in a single line
+    char key_[kKeySize]{};         // sec-websocket-key of a client
+    State state_{kStatusLine};
+    size_t pos_{0};  // start of the current line
+    size_t sep_{0};  // colon of the current field line
+    size_t scan_{0}; // first byte not scanned yet
 
     void set_size(size_t n) { size_ = n; }
 
-    static void to_lower(char* data, size_t n)
+    void clear()
+    {
+      nfields_ = 0;
+      std::fill(std::begin(known_), std::end(known_), uint8_t{0});
+      for(size_t i = 0; i < 2; ++i)
+      {
+        lists_[i].clear();
+        joined_[i] = {};
+      }
+    }
+
+    // another line of a list field, only a repeated field allocates
+    void join(Known k, const nm::string_view& value)
+    {
+      if(value.empty())
+      {
+        return;
+      }
+      auto& s = lists_[k - kSecProtocol];
+      if(s.empty())
+      {
+        auto& first = fields_[known_[k] - 1].value;
+        s.assign(first.data(), first.size());
+      }
+      if(!s.empty())
+      {
+        s.append(", ");
+      }
+      s.append(value.data(), value.size());
+      joined_[k - kSecProtocol] = nm::string_view{s.data(), s.size()};
+    }
+
+    // views into h.key_ are moved to our own copy
+    void assign(header& h)
+    {
+      is_client_ = h.is_client_;
+      size_ = h.size_;
+      method_ = h.method_;
+      code_ = h.code_;
+      path_ = h.path_;
+      version_ = h.version_;
+      nfields_ = h.nfields_;
+      state_ = h.state_;
+      pos_ = h.pos_;
+      sep_ = h.sep_;
+      scan_ = h.scan_;
+      std::copy(std::begin(h.known_), std::end(h.known_), std::begin(known_));
+      for(size_t i = 0; i < 2; ++i)
+      {
+        lists_[i] = std::move(h.lists_[i]);
+        joined_[i] = h.joined_[i].empty() ? nm::string_view{} : nm::string_view{lists_[i].data(), lists_[i].size()};
+        h.lists_[i].clear();
+        h.joined_[i] = {};
+      }
+      ::memcpy(key_, h.key_, kKeySize);
+      for(size_t i = 0; i < nfields_; ++i)
+      {
+        fields_[i] = h.fields_[i];
+        auto p = fields_[i].value.data();
+        if(p >= h.key_ && p < h.key_ + kKeySize)
+        {
+          fields_[i].value = nm::string_view{key_ + (p - h.key_), fields_[i].value.size()};
+        }
+      }
+    }
+
+    // the known names have distinct lengths, so the length is a perfect hash and one compare confirms the match
+    static Known known_slot(const nm::string_view& key)
     {
-      for(size_t i = 0; i < n; ++i)
+      struct Entry
       {
-        data[i] = std::tolower(data[i]);
+        const char* name;
+        Known slot;
+      };
+      static const Entry table[32] = {
+        {},
+        {},
+        {},
+        {},
+        {"host", kHost},
+        {},
+        {"origin", kOrigin},
+        {"upgrade", kUpgrade},
+        {},
+        {},
+        {"connection", kConnection},
+        {},
+        {},
+        {},
+        {},
+        {},
+        {},
+        {"sec-websocket-key", kSecKey},
+        {},
+        {},
+        {"sec-websocket-accept", kSecAccept},
+        {"sec-websocket-version", kSecVersion},
+        {"sec-websocket-protocol", kSecProtocol},
+        {},
+        {"sec-websocket-extensions", kSecExtensions},
+        {},
+        {},
+        {},
+        {},
+        {},
+        {},
+        {},
+      };
+      if(key.size() >= 32)
+      {
+        return kUnknown;
+      }
+      auto& e = table[key.size()];
+      if(e.name == nullptr || !iequals(key, nm::string_view{e.name, key.size()}))
+      {
+        return kUnknown;
       }
+      return e.slot;
     }
 
-    static const std::string& ws_gen_key()
+    static char lower(char c) { return c >= 'A' && c <= 'Z' ? static_cast<char>(c + ('a' - 'A')) : c; }
+
+    static bool iequals(const nm::string_view& a, const nm::string_view& b)
+    {
+      if(a.size() != b.size())
+      {
+        return false;
+      }
+      for(size_t i = 0; i < a.size(); ++i)
+      {
+        if(lower(a.data()[i]) != lower(b.data()[i]))
+        {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    // offset of the first `a` or `b` in `p`, `n` when there's none
+    static size_t find_any(const char* p, size_t n, char a, char b)
+    {
+      size_t i = 0;
+#ifdef NM_SSE2
+      auto va = _mm_set1_epi8(a);
+      auto vb = _mm_set1_epi8(b);
+      for(; i + 16 <= n; i += 16)
+      {
+        auto x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        auto m = static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(x, va), _mm_cmpeq_epi8(x, vb))));
+        if(m != 0)
+        {
+          return i + nm::ctz(m);
+        }
+      }
+#endif
+      for(; i < n; ++i)
+      {
+        if(p[i] == a || p[i] == b)
+        {
+          return i;
+        }
+      }
+      return n;
+    }
+
+    static header_error parse_request_line(header& h, const nm::string_view& line)
+    {
+      static nm::string_view prefix{"GET"};
+      auto idx = line.rfind("HTTP/");
+      if(idx == line.npos)
+      {
+        return header_error::invalid_status_line;
+      }
+
+      auto ver = line.substr(idx + 5, line.size()).trim();
+      if(ver != "1.1")
+      {
+        return header_error::invalid_status_line;
+      }
+
+      auto path = line.substr(0, idx).remove_prefix(prefix.size()).trim();
+      h.set_version(ver);
+      h.set_path(path);
+      return header_error::ok;
+    }
+
+    static header_error parse_status_line(header& h, nm::string_view line)
+    {
+      static nm::string_view prefix{"HTTP/1.1"};
+      line = line.substr(prefix.size(), line.size()).trim();
+      auto idx = line.find(' ');
+      if(idx == line.npos)
+      {
+        return header_error::invalid_status_line;
+      }
+
+      auto code = line.substr(0, idx).trim();
+
+      h.set_code(code);
+      if(code != "101")
+      {
+        return header_error::invalid_status_line;
+      }
+      return header_error::ok;
+    }
+
+    // every byte is scanned once however the header is split, a partial line is picked up at scan_
+    header_error parse(const char* data, size_t n, bool is_request)
+    {
+      for(;;)
+      {
+        switch(state_)
+        {
+        case kStatusLine:
+        {
+          auto cr = scan_ + find_any(data + scan_, n - scan_, '\r', '\r');
+          if(cr > kMaxLineSize)
+          {
+            return header_error::line_too_long;
+          }
+          if(cr + 1 >= n)
+          {
+            scan_ = cr < n ? cr : n;
+            return header_error::more;
+          }
+          if(data[cr + 1] != '\n')
+          {
+            return header_error::invalid_status_line;
+          }
+          auto line = nm::string_view{data, cr}.trim();
+          auto r = is_request ? parse_request_line(*this, line) : parse_status_line(*this, line);
+          if(r != header_error::ok)
+          {
+            return r;
+          }
+          // a client replaces its request fields with the response ones, the key it sent stays in key_
+          this->clear();
+          pos_ = cr + 2;
+          state_ = kLineStart;
+          break;
+        }
+        case kLineStart:
+          if(pos_ >= n)
+          {
+            return header_error::more;
+          }
+          if(data[pos_] == '\r')
+          {
+            if(pos_ + 1 >= n)
+            {
+              return header_error::more;
+            }
+            if(data[pos_ + 1] != '\n')
+            {
+              return header_error::invalid_field_format;
+            }
+            size_ = pos_ + 2; // including CRLFs
+            state_ = kDone;
+            break;
+          }
+          scan_ = pos_;
+          state_ = kFieldName;
+          break;
+        case kFieldName:
+        {
+          auto sep = scan_ + find_any(data + scan_, n - scan_, ':', '\r');
+          if(sep - pos_ > kMaxLineSize)
+          {
+            return header_error::line_too_long;
+          }
+          if(sep == n)
+          {
+            scan_ = n;
+            return header_error::more;
+          }
+          if(data[sep] != ':')
+          {
+            return header_error::invalid_field_format;
+          }
+          sep_ = sep;
+          scan_ = sep + 1;
+          state_ = kFieldValue;
+          break;
+        }
+        case kFieldValue:
+        {
+          auto eol = scan_ + find_any(data + scan_, n - scan_, '\r', '\r');
+          if(eol - pos_ > kMaxLineSize)
+          {
+            return header_error::line_too_long;
+          }
+          if(eol + 1 >= n)
+          {
+            scan_ = eol < n ? eol : n;
+            return header_error::more;
+          }
+          if(data[eol + 1] != '\n')
+          {
+            return header_error::invalid_field_format;
+          }
+          auto key = nm::string_view{data + pos_, sep_ - pos_}.trim();
+          auto val = nm::string_view{data + sep_ + 1, eol - sep_ - 1}.trim();
+          if(!this->set(key, val))
+          {
+            return header_error::too_many_fields;
+          }
+          pos_ = eol + 2;
+          state_ = kLineStart;
+          break;
+        }
+        case kDone:
+          return header_error::ok;
+        }
+      }
+    }
+
+    // random nonce into key_
+    void ws_gen_key()
     {
       constexpr static char b[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
       constexpr static int len = 16;
       static std::random_device rd;
-      static thread_local std::string key;
       std::mt19937 eng{rd()};
-      std::string res(len, '\0');
+      char res[len];
       for(int i = 0; i < len; ++i)
       {
         res[i] = b[eng() % len];
       }
-      key = nm::base64_encode(res);
-      return key;
+      nm::base64_encode(key_, res, len);
     }
 
-    static const std::string& ws_gen_accept_key(const nm::string_view& key)
+    // write the kAcceptKeySize bytes accept key for `key` to `out`
+    static void ws_gen_accept_key(const nm::string_view& key, char* out)
     {
-      static thread_local std::string acc_key;
-      std::string tmp = key.to_string() + GUID;
-      tmp = nm::Sha1::sha1(tmp);
-      acc_key = nm::base64_encode(tmp);
-      return acc_key;
+      unsigned char digest[nm::Sha1::DIGEST_SIZE];
+      nm::Sha1 sh;
+      sh.update(key.data(), key.size());
+      sh.update(GUID, sizeof(GUID) - 1);
+      sh.final(digest);
+      nm::base64_encode(out, digest, sizeof(digest));
+    }
+
+    // a "name:value" field line at `p`, `name` includes the colon. return the end of it
+    static char* put_field(char* p, const char* name, size_t n, const nm::string_view& value)
+    {
+      ::memcpy(p, name, n);
+      p += n;
+      ::memcpy(p, value.data(), value.size());
+      p += value.size();
+      ::memcpy(p, CRLF, sizeof(CRLF) - 1);
+      return p + sizeof(CRLF) - 1;
     }
 
     static bool ws_verify_key(const nm::string_view& key, const nm::string_view& accept_key)
     {
-      nm::string_view ekey = ws_gen_accept_key(key);
-      if(accept_key == ekey)
+      char ekey[kAcceptKeySize];
+      ws_gen_accept_key(key, ekey);
+      return accept_key == nm::string_view{ekey, kAcceptKeySize};
+    }
+
+    // `v` contains `token` ignoring case, `token` is lower case
+    static bool contains_token(const nm::string_view& v, const nm::string_view& token)
+    {
+      for(size_t i = 0; i + token.size() <= v.size(); ++i)
       {
-        return true;
+        size_t k = 0;
+        while(k < token.size() && lower(v.data()[i + k]) == token.data()[k])
+        {
+          k += 1;
+        }
+        if(k == token.size())
+        {
+          return true;
+        }
       }
       return false;
     }
@@ -0,0 +1,366 @@
+/*********************************************************
+          File Name: mask.h
+          Author: Abby Cin
+          Mail: abbytsing@gmail.com
+          Created Time: Sun 18 Oct 2026 10:40:07 AM CST
+**********************************************************/
+
+#ifndef WS_MASK_H
+#define WS_MASK_H
+
+#include <cstring>
+#include "cpu.h"
+#include "utf8.h"
+
+namespace ws
+{
+  namespace detail
+  {
+    using mask_fn = void (*)(char*, size_t, uint32_t);
+    using mask_copy_fn = void (*)(char*, const char*, size_t, uint32_t);
+
+    // key to use when masking starts `offset` bytes into a payload masked by `key`
+    inline uint32_t rotate_mask_key(uint32_t key, size_t offset)
+    {
+      uint8_t k[sizeof(key)];
+      uint8_t r[sizeof(key)];
+      std::memcpy(k, &key, sizeof(key));
+      for(size_t i = 0; i < sizeof(key); ++i)
+      {
+        r[i] = k[(offset + i) & 3u];
+      }
+      std::memcpy(&key, r, sizeof(key));
+      return key;
+    }
+
+    inline void mask_scalar(char* data, size_t n, uint32_t key)
+    {
+      uint64_t k = (static_cast<uint64_t>(key) << 32u) | key; // same byte pattern on both endian
+      size_t i = 0;
+      for(; i + sizeof(k) <= n; i += sizeof(k))
+      {
+        uint64_t x;
+        std::memcpy(&x, data + i, sizeof(x));
+        x ^= k;
+        std::memcpy(data + i, &x, sizeof(x));
+      }
+      auto kb = reinterpret_cast<const uint8_t*>(&key);
+      for(; i < n; ++i)
+      {
+        data[i] ^= kb[i & 3u];
+      }
+    }
+
+    inline void mask_copy_scalar(char* dst, const char* src, size_t n, uint32_t key)
+    {
+      uint64_t k = (static_cast<uint64_t>(key) << 32u) | key;
+      size_t i = 0;
+      for(; i + sizeof(k) <= n; i += sizeof(k))
+      {
+        uint64_t x;
+        std::memcpy(&x, src + i, sizeof(x));
+        x ^= k;
+        std::memcpy(dst + i, &x, sizeof(x));
+      }
+      auto kb = reinterpret_cast<const uint8_t*>(&key);
+      for(; i < n; ++i)
+      {
+        dst[i] = static_cast<char>(src[i] ^ kb[i & 3u]);
+      }
+    }
+
+#ifdef NM_X86
+    // bytes before `p` reaches an `align` boundary, at most `n`
+    inline size_t mask_head(const char* p, size_t n, size_t align)
+    {
+      size_t head = (align - (reinterpret_cast<uintptr_t>(p) & (align - 1))) & (align - 1);
+      return head < n ? head : n;
+    }
+
+    NM_TARGET("sse2") inline void mask_sse2(char* data, size_t n, uint32_t key)
+    {
+      if(n < 32)
+      {
+        mask_scalar(data, n, key);
+        return;
+      }
+      size_t head = mask_head(data, n, 16);
+      mask_scalar(data, head, key);
+      key = rotate_mask_key(key, head);
+      data += head;
+      n -= head;
+
+      // vector width is a multiple of 4, key phase never changes in the loop
+      __m128i k = _mm_set1_epi32(static_cast<int>(key));
+      size_t i = 0;
+      for(; i + 16 <= n; i += 16)
+      {
+        auto p = reinterpret_cast<__m128i*>(data + i);
+        _mm_store_si128(p, _mm_xor_si128(_mm_load_si128(p), k));
+      }
+      mask_scalar(data + i, n - i, key);
+    }
+
+    NM_TARGET("avx2") inline void mask_avx2(char* data, size_t n, uint32_t key)
+    {
+      if(n < 64)
+      {
+        mask_scalar(data, n, key);
+        return;
+      }
+      size_t head = mask_head(data, n, 32);
+      mask_scalar(data, head, key);
+      key = rotate_mask_key(key, head);
+      data += head;
+      n -= head;
+
+      __m256i k = _mm256_set1_epi32(static_cast<int>(key));
+      size_t i = 0;
+      for(; i + 128 <= n; i += 128)
+      {
+        auto p = reinterpret_cast<__m256i*>(data + i);
+        auto x0 = _mm256_load_si256(p);
+        auto x1 = _mm256_load_si256(p + 1);
+        auto x2 = _mm256_load_si256(p + 2);
+        auto x3 = _mm256_load_si256(p + 3);
+        _mm256_store_si256(p, _mm256_xor_si256(x0, k));
+        _mm256_store_si256(p + 1, _mm256_xor_si256(x1, k));
+        _mm256_store_si256(p + 2, _mm256_xor_si256(x2, k));
+        _mm256_store_si256(p + 3, _mm256_xor_si256(x3, k));
+      }
+      for(; i + 32 <= n; i += 32)
+      {
+        auto p = reinterpret_cast<__m256i*>(data + i);
+        _mm256_store_si256(p, _mm256_xor_si256(_mm256_load_si256(p), k));
+      }
+      mask_scalar(data + i, n - i, key);
+    }
+
+    NM_TARGET("avx512f,avx512bw") inline void mask_avx512(char* data, size_t n, uint32_t key)
+    {
+      if(n < 64)
+      {
+        mask_scalar(data, n, key);
+        return;
+      }
+      __m512i k = _mm512_set1_epi32(static_cast<int>(key));
+
+      // head and tail use masked load/store, which never touch the bytes outside the payload
+      size_t head = mask_head(data, n, 64);
+      if(head)
+      {
+        __mmask64 m = ~0ull >> (64 - head);
+        _mm512_mask_storeu_epi8(data, m, _mm512_xor_si512(_mm512_maskz_loadu_epi8(m, data), k));
+        key = rotate_mask_key(key, head);
+        k = _mm512_set1_epi32(static_cast<int>(key));
+        data += head;
+        n -= head;
+      }
+
+      size_t i = 0;
+      for(; i + 128 <= n; i += 128)
+      {
+        auto p = reinterpret_cast<__m512i*>(data + i);
+        auto x0 = _mm512_load_si512(p);
+        auto x1 = _mm512_load_si512(p + 1);
+        _mm512_store_si512(p, _mm512_xor_si512(x0, k));
+        _mm512_store_si512(p + 1, _mm512_xor_si512(x1, k));
+      }
+      for(; i + 64 <= n; i += 64)
+      {
+        auto p = reinterpret_cast<__m512i*>(data + i);
+        _mm512_store_si512(p, _mm512_xor_si512(_mm512_load_si512(p), k));
+      }
+      if(i < n)
+      {
+        __mmask64 m = ~0ull >> (64 - (n - i));
+        _mm512_mask_storeu_epi8(data + i, m, _mm512_xor_si512(_mm512_maskz_loadu_epi8(m, data + i), k));
+      }
+    }
+
+    // the copy kernels align the stores, source is loaded unaligned
+    NM_TARGET("sse2") inline void mask_copy_sse2(char* dst, const char* src, size_t n, uint32_t key)
+    {
+      if(n < 32)
+      {
+        mask_copy_scalar(dst, src, n, key);
+        return;
+      }
+      size_t head = mask_head(dst, n, 16);
+      mask_copy_scalar(dst, src, head, key);
+      key = rotate_mask_key(key, head);
+      dst += head;
+      src += head;
+      n -= head;
+
+      __m128i k = _mm_set1_epi32(static_cast<int>(key));
+      size_t i = 0;
+      for(; i + 16 <= n; i += 16)
+      {
+        auto x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_store_si128(reinterpret_cast<__m128i*>(dst + i), _mm_xor_si128(x, k));
+      }
+      mask_copy_scalar(dst + i, src + i, n - i, key);
+    }
+
+    NM_TARGET("avx2") inline void mask_copy_avx2(char* dst, const char* src, size_t n, uint32_t key)
+    {
+      if(n < 64)
+      {
+        mask_copy_scalar(dst, src, n, key);
+        return;
+      }
+      size_t head = mask_head(dst, n, 32);
+      mask_copy_scalar(dst, src, head, key);
+      key = rotate_mask_key(key, head);
+      dst += head;
+      src += head;
+      n -= head;
+
+      __m256i k = _mm256_set1_epi32(static_cast<int>(key));
+      size_t i = 0;
+      for(; i + 128 <= n; i += 128)
+      {
+        auto s = reinterpret_cast<const __m256i*>(src + i);
+        auto d = reinterpret_cast<__m256i*>(dst + i);
+        auto x0 = _mm256_loadu_si256(s);
+        auto x1 = _mm256_loadu_si256(s + 1);
+        auto x2 = _mm256_loadu_si256(s + 2);
+        auto x3 = _mm256_loadu_si256(s + 3);
+        _mm256_store_si256(d, _mm256_xor_si256(x0, k));
+        _mm256_store_si256(d + 1, _mm256_xor_si256(x1, k));
+        _mm256_store_si256(d + 2, _mm256_xor_si256(x2, k));
+        _mm256_store_si256(d + 3, _mm256_xor_si256(x3, k));
+      }
+      for(; i + 32 <= n; i += 32)
+      {
+        auto x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        _mm256_store_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_xor_si256(x, k));
+      }
+      mask_copy_scalar(dst + i, src + i, n - i, key);
+    }
+
+    NM_TARGET("avx512f,avx512bw") inline void mask_copy_avx512(char* dst, const char* src, size_t n, uint32_t key)
+    {
+      if(n < 64)
+      {
+        mask_copy_scalar(dst, src, n, key);
+        return;
+      }
+      __m512i k = _mm512_set1_epi32(static_cast<int>(key));
+      size_t head = mask_head(dst, n, 64);
+      if(head)
+      {
+        __mmask64 m = ~0ull >> (64 - head);
+        _mm512_mask_storeu_epi8(dst, m, _mm512_xor_si512(_mm512_maskz_loadu_epi8(m, src), k));
+        key = rotate_mask_key(key, head);
+        k = _mm512_set1_epi32(static_cast<int>(key));
+        dst += head;
+        src += head;
+        n -= head;
+      }
+
+      size_t i = 0;
+      for(; i + 128 <= n; i += 128)
+      {
+        auto s = reinterpret_cast<const __m512i*>(src + i);
+        auto d = reinterpret_cast<__m512i*>(dst + i);
+        auto x0 = _mm512_loadu_si512(s);
+        auto x1 = _mm512_loadu_si512(s + 1);
+        _mm512_store_si512(d, _mm512_xor_si512(x0, k));
+        _mm512_store_si512(d + 1, _mm512_xor_si512(x1, k));
+      }
+      for(; i + 64 <= n; i += 64)
+      {
+        auto x = _mm512_loadu_si512(reinterpret_cast<const __m512i*>(src + i));
+        _mm512_store_si512(reinterpret_cast<__m512i*>(dst + i), _mm512_xor_si512(x, k));
+      }
+      if(i < n)
+      {
+        __mmask64 m = ~0ull >> (64 - (n - i));
+        _mm512_mask_storeu_epi8(dst + i, m, _mm512_xor_si512(_mm512_maskz_loadu_epi8(m, src + i), k));
+      }
+    }
+#endif
+
+    inline mask_fn select_mask_kernel()
+    {
+#ifdef NM_X86
+      auto& c = nm::cpu();
+      if(c.avx512bw)
+      {
+        return mask_avx512;
+      }
+      if(c.avx2)
+      {
+        return mask_avx2;
+      }
+      if(c.sse2)
+      {
+        return mask_sse2;
+      }
+#endif
+      return mask_scalar;
+    }
+
+    inline mask_copy_fn select_mask_copy_kernel()
+    {
+#ifdef NM_X86
+      auto& c = nm::cpu();
+      if(c.avx512bw)
+      {
+        return mask_copy_avx512;
+      }
+      if(c.avx2)
+      {
+        return mask_copy_avx2;
+      }
+      if(c.sse2)
+      {
+        return mask_copy_sse2;
+      }
+#endif
+      return mask_copy_scalar;
+    }
+
+    // mask/unmask are the same
+    inline void mask(char* data, size_t n, uint32_t mask_key)
+    {
+      static const mask_fn kernel = select_mask_kernel();
+      kernel(data, n, mask_key);
+    }
+
+    // copy `n` bytes from `src` to `dst` masked, `dst` and `src` must not overlap
+    inline void mask_copy(char* dst, const char* src, size_t n, uint32_t mask_key)
+    {
+      static const mask_copy_fn kernel = select_mask_copy_kernel();
+      kernel(dst, src, n, mask_key);
+    }
+
+    // unmask and validate a text payload in blocks that stay in L1, so every byte is fetched from memory only once
+    inline bool unmask_utf8(char* data, size_t n, uint32_t mask_key)
+    {
+      constexpr size_t block = 4096; // multiple of 4, key never rotates
+      size_t checked = 0;
+      for(size_t done = 0; done < n;)
+      {
+        size_t len = n - done < block ? n - done : block;
+        if(mask_key != 0)
+        {
+          mask(data + done, len, mask_key);
+        }
+        done += len;
+        // a code point split by the block boundary is validated with the next block
+        size_t cut = done == n ? n : checked + nm::UTF8::last_boundary(data + checked, done - checked);
+        if(!nm::UTF8::validate(data + checked, cut - checked))
+        {
+          return false;
+        }
+        checked = cut;
+      }
+      return true;
+    }
+  }
+}
+
+#endif // WS_MASK_H
@@ -0,0 +1,105 @@
+/*********************************************************
+          File Name: prepared.h
+          Author: Abby Cin
+          Mail: abbytsing@gmail.com
+          Created Time: Sun 18 Oct 2026 07:40:05 PM CST
+**********************************************************/
+
+#ifndef WS_PREPARED_H
+#define WS_PREPARED_H
+
+namespace ws
+{
+  // a message framed once and written to any number of streams, e.g. a broadcast. it's immutable once built apart
+  // from an internal cache and is shared through std::shared_ptr, streams of different threads included.
+  // every encoding a stream's extensions produce (see extension::encoding_id) is made once and kept here, so N
+  // subscribers sharing a configuration cost one compression. it's always sent as a single frame, a server stream
+  // writes the cached bytes as is while a client one still masks a copy
+  class prepared_message
+  {
+  public:
+    explicit prepared_message(const Buffer& payload, bool binary = false)
+        : code_{binary ? detail::opcode::binary : detail::opcode::text},
+          payload_{payload.peek(), payload.readable_size()}
+    {
+      // the encoding of streams without extensions
+      this->add(std::string{}, payload, 0);
+    }
+
+    prepared_message(const prepared_message&) = delete;
+
+    prepared_message& operator=(const prepared_message&) = delete;
+
+    bool is_binary() const { return code_ == detail::opcode::binary; }
+
+    // the message as given
+    Buffer payload() const { return buffer(payload_); }
+
+    detail::opcode code() const { return code_; }
+
+    struct Encoding
+    {
+      std::string key;
+      uint8_t rsv;
+      size_t header_size;
+      std::string frame; // header of an unmasked frame followed by the encoded payload
+
+      Buffer wire() const { return buffer(frame); }
+
+      Buffer payload() const { return buffer(frame.data() + header_size, frame.size() - header_size); }
+    };
+
+    // nullptr when streams with `key` haven't sent it yet
+    const Encoding* find(const std::string& key) const
+    {
+      std::lock_guard<std::mutex> lg{mtx_};
+      for(auto& e: encodings_)
+      {
+        if(e.key == key)
+        {
+          return &e;
+        }
+      }
+      return nullptr;
+    }
+
+    // the first one wins when two streams encode it concurrently
+    const Encoding* add(std::string key, const Buffer& payload, uint8_t rsv) const
+    {
+      Encoding e{std::move(key), rsv, 0, {}};
+      detail::WsFrame f{};
+      f.set_rsv(rsv);
+      f.set_fin();
+      f.set_mask(false);
+      f.set_code(code_);
+      f.set_payload_size(payload.readable_size());
+      char hdr[kMaxHeaderSize];
+      e.header_size = f.build(hdr);
+      e.frame.reserve(e.header_size + payload.readable_size());
+      e.frame.append(hdr, e.header_size);
+      e.frame.append(payload.peek(), payload.readable_size());
+
+      std::lock_guard<std::mutex> lg{mtx_};
+      for(auto& x: encodings_)
+      {
+        if(x.key == e.key)
+        {
+          return &x;
+        }
+      }
+      // a list, references handed out stay valid
+      encodings_.push_back(std::move(e));
+      return &encodings_.back();
+    }
+
+  private:
+    constexpr static size_t kMaxHeaderSize = 14;
+
+    detail::opcode code_;
+    std::string payload_;
+    mutable std::mutex mtx_;
+    mutable std::list<Encoding> encodings_;
+  };
+}
+
+#endif // WS_PREPARED_H
@@ -8,29 +8,30 @@
 #ifndef SHA1_H_
 #define SHA1_H_
 
+#include "cpu.h"
+#include <cstring>
 #include <string>
+#include <utility>
 
 namespace nm
 {
   // take from chromium/base/sha1_portable.cc
   class Sha1
   {
+    // compress `n` 64 bytes blocks into `h`
+    using compress_fn = void (*)(uint32_t* h, const uint8_t* data, size_t n);
+
+  public:
     enum
     {
       DIGEST_SIZE = 20
     };
 
-  public:
     Sha1() { this->init(); }
 
     // for resuing code
     void init()
     {
-      A = 0;
-      B = 0;
-      C = 0;
-      D = 0;
-      E = 0;
       cursor = 0;
       l = 0;
       H[0] = 0x67452301;
@@ -42,22 +43,41 @@ namespace nm
 
     void update(const void* data, size_t nbytes)
     {
+      if(nbytes == 0)
+      {
+        return;
+      }
+      auto compress = kernel();
       const uint8_t* d = reinterpret_cast<const uint8_t*>(data);
-      while(nbytes--)
+      l += static_cast<uint64_t>(nbytes) * 8;
+      if(cursor > 0)
       {
-        M[cursor++] = *d++;
-        if(cursor >= 64)
+        size_t n = 64 - cursor < nbytes ? 64 - cursor : nbytes;
+        ::memcpy(M + cursor, d, n);
+        cursor += static_cast<uint32_t>(n);
+        d += n;
+        nbytes -= n;
+        if(cursor < 64)
         {
-          process();
+          return;
         }
-        l += 8;
+        compress(H, M, 1);
+        cursor = 0;
       }
+      // whole blocks are hashed straight from the input
+      if(nbytes >= 64)
+      {
+        compress(H, d, nbytes / 64);
+        d += nbytes & ~size_t(63);
+        nbytes &= 63;
+      }
+      ::memcpy(M, d, nbytes);
+      cursor = static_cast<uint32_t>(nbytes);
     }
 
     void final()
     {
       pad();
-      process();
 
       for(int t = 0; t < 5; ++t)
       {
@@ -65,6 +85,13 @@ namespace nm
       }
     }
 
+    // finish and write the digest to `res`, which must hold DIGEST_SIZE bytes
+    void final(unsigned char* res)
+    {
+      this->final();
+      ::memcpy(res, H, DIGEST_SIZE);
+    }
+
     const unsigned char* digest() const { return reinterpret_cast<const unsigned char*>(H); }
 
     static std::string sha1(const std::string& str)
@@ -78,93 +105,174 @@ namespace nm
     {
       Sha1 sh;
       sh.update(data, len);
-      sh.final();
-      ::memcpy(res, sh.digest(), DIGEST_SIZE);
+      sh.final(res);
     }
 
-  private:
-    uint32_t A, B, C, D, E;
-    uint32_t H[5];
-    uint32_t cursor;
-    uint32_t l;
-    union
+    static void compress_scalar(uint32_t* h, const uint8_t* data, size_t n)
     {
       uint32_t W[80];
-      uint8_t M[64];
-    };
+      for(; n > 0; --n, data += 64)
+      {
+        uint32_t t;
 
-    void pad()
-    {
-      M[cursor++] = 0x80;
+        // Each a...e corresponds to a section in the FIPS 180-3 algorithm.
 
-      if(cursor > 64 - 8)
-      {
-        // pad out to next block
-        while(cursor < 64)
+        // a.
+        for(t = 0; t < 16; ++t)
         {
-          M[cursor++] = 0;
+          ::memcpy(&W[t], data + t * 4, 4);
+          swapends(&W[t]);
+        }
+
+        // b.
+        for(t = 16; t < 80; ++t)
+        {
+          W[t] = S(1, W[t - 3] ^ W[t - 8] ^ W[t - 14] ^ W[t - 16]);
+        }
+
+        // c.
+        uint32_t A = h[0];
+        uint32_t B = h[1];
+        uint32_t C = h[2];
+        uint32_t D = h[3];
+        uint32_t E = h[4];
+
+        // d.
+        for(t = 0; t < 80; ++t)
+        {
+          uint32_t TEMP = S(5, A) + f(t, B, C, D) + E + W[t] + K(t);
+          E = D;
+          D = C;
+          C = S(30, B);
+          B = A;
+          A = TEMP;
         }
 
-        process();
+        // e.
+        h[0] += A;
+        h[1] += B;
+        h[2] += C;
+        h[3] += D;
+        h[4] += E;
       }
+    }
 
-      while(cursor < 64 - 4)
+#ifdef NM_X86
+    // intel SHA extensions, every sha1rnds4 does 4 rounds while the schedule for the next ones is computed
+    NM_TARGET("sha,sse4.1") static void compress_shani(uint32_t* h, const uint8_t* data, size_t n)
+    {
+      const __m128i be = _mm_set_epi64x(0x0001020304050607ll, 0x08090a0b0c0d0e0fll);
+      __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(h)), 0x1b);
+      __m128i e0 = _mm_set_epi32(static_cast<int>(h[4]), 0, 0, 0);
+      for(; n > 0; --n, data += 64)
       {
-        M[cursor++] = 0;
+        __m128i abcd_save = abcd;
+        __m128i e_save = e0;
+        __m128i e[2] = {e0, _mm_setzero_si128()};
+        __m128i msg[4];
+        shani_groups(abcd, e, msg, data, be, std::make_index_sequence<20>{});
+        // the last group runs on e[1], e[0] holds abcd from before it
+        e0 = _mm_sha1nexte_epu32(e[0], e_save);
+        abcd = _mm_add_epi32(abcd, abcd_save);
       }
-
-      M[64 - 4] = (l & 0xff000000) >> 24;
-      M[64 - 3] = (l & 0xff0000) >> 16;
-      M[64 - 2] = (l & 0xff00) >> 8;
-      M[64 - 1] = (l & 0xff);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(h), _mm_shuffle_epi32(abcd, 0x1b));
+      h[4] = static_cast<uint32_t>(_mm_extract_epi32(e0, 3));
     }
+#endif
 
-    void process()
+  private:
+    uint32_t H[5];
+    uint32_t cursor;
+    uint64_t l;
+    uint8_t M[64];
+
+    static compress_fn select_kernel()
     {
-      uint32_t t;
+#ifdef NM_X86
+      if(nm::cpu().sha)
+      {
+        return compress_shani;
+      }
+#endif
+      return compress_scalar;
+    }
 
-      // Each a...e corresponds to a section in the FIPS 180-3 algorithm.
+    static compress_fn kernel()
+    {
+      static const compress_fn k = select_kernel();
+      return k;
+    }
 
-      // a.
-      //
-      // W and M are in a union, so no need to memcpy.
-      // memcpy(W, M, sizeof(M));
-      for(t = 0; t < 16; ++t)
+#ifdef NM_X86
+    // rounds 4G .. 4G+3. msg[G % 4] holds W[4G .. 4G+3] and the schedule slots are rotated, every step below touches
+    // a slot other than msg[G % 4] so they can be issued in any order
+    template<int G>
+    NM_TARGET("sha,sse4.1")
+    static void shani_group(__m128i& abcd, __m128i (&e)[2], __m128i (&msg)[4], const uint8_t* data, __m128i be)
+    {
+      if constexpr(G < 4)
       {
-        swapends(&W[t]);
+        msg[G] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + G * 16)), be);
       }
-
-      // b.
-      for(t = 16; t < 80; ++t)
+      if constexpr(G == 0)
+      {
+        e[0] = _mm_add_epi32(e[0], msg[0]);
+      }
+      else
       {
-        W[t] = S(1, W[t - 3] ^ W[t - 8] ^ W[t - 14] ^ W[t - 16]);
+        e[G % 2] = _mm_sha1nexte_epu32(e[G % 2], msg[G % 4]);
       }
+      e[(G + 1) % 2] = abcd;
+      abcd = _mm_sha1rnds4_epu32(abcd, e[G % 2], G / 5);
+      if constexpr(G >= 1 && G <= 16)
+      {
+        msg[(G + 3) % 4] = _mm_sha1msg1_epu32(msg[(G + 3) % 4], msg[G % 4]);
+      }
+      if constexpr(G >= 2 && G <= 17)
+      {
+        msg[(G + 2) % 4] = _mm_xor_si128(msg[(G + 2) % 4], msg[G % 4]);
+      }
+      if constexpr(G >= 3 && G <= 18)
+      {
+        msg[(G + 1) % 4] = _mm_sha1msg2_epu32(msg[(G + 1) % 4], msg[G % 4]);
+      }
+    }
 
-      // c.
-      A = H[0];
-      B = H[1];
-      C = H[2];
-      D = H[3];
-      E = H[4];
+    template<size_t... G>
+    NM_TARGET("sha,sse4.1")
+    static void shani_groups(__m128i& abcd, __m128i (&e)[2], __m128i (&msg)[4], const uint8_t* data, __m128i be,
+                             std::index_sequence<G...>)
+    {
+      (shani_group<static_cast<int>(G)>(abcd, e, msg, data, be), ...);
+    }
+#endif
 
-      // d.
-      for(t = 0; t < 80; ++t)
+    void pad()
+    {
+      M[cursor++] = 0x80;
+
+      if(cursor > 64 - 8)
       {
-        uint32_t TEMP = S(5, A) + f(t, B, C, D) + E + W[t] + K(t);
-        E = D;
-        D = C;
-        C = S(30, B);
-        B = A;
-        A = TEMP;
+        // pad out to next block
+        while(cursor < 64)
+        {
+          M[cursor++] = 0;
+        }
+
+        kernel()(H, M, 1);
+        cursor = 0;
       }
 
-      // e.
-      H[0] += A;
-      H[1] += B;
-      H[2] += C;
-      H[3] += D;
-      H[4] += E;
+      while(cursor < 64 - 8)
+      {
+        M[cursor++] = 0;
+      }
 
+      for(int i = 0; i < 8; ++i)
+      {
+        M[64 - 1 - i] = static_cast<uint8_t>(l >> (i * 8));
+      }
+      kernel()(H, M, 1);
       cursor = 0;
     }
 
@@ -164,7 +164,7 @@ namespace nm
         return {};
       }
 
-      while(*res.data() == ' ' || *res.data() == '\r' || *res.data() == '\n' || *res.data() == '\t')
+      while(!res.empty() && (*res.data() == ' ' || *res.data() == '\r' || *res.data() == '\n' || *res.data() == '\t'))
       {
         res.remove_prefix(1);
       }
@@ -8,93 +8,423 @@
 #ifndef UTF_8_H_
 #define UTF_8_H_
 
-#ifdef B0 // fuck windows
-#undef B0
-#endif
+#include "cpu.h"
+#include <cstdint>
+#include <cstring>
 
 namespace nm
 {
+  // RFC 3629 validation, rejects overlong forms, surrogates, code points above U+10FFFF and truncated sequences
   class UTF8
   {
-    enum Type : unsigned char
+    using validate_fn = bool (*)(const char*, size_t);
+
+    static bool is_cont(unsigned char x) { return (x & 0xc0u) == 0x80u; }
+
+    // length of the leading pure ASCII run, 8 bytes at a time
+    static size_t ascii_prefix(const char* s, size_t len)
+    {
+      size_t i = 0;
+      for(; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t))
+      {
+        uint64_t w;
+        std::memcpy(&w, s + i, sizeof(w));
+        if(w & 0x8080808080808080ull)
+        {
+          break;
+        }
+      }
+      while(i < len && static_cast<unsigned char>(s[i]) < 0x80u)
+      {
+        i += 1;
+      }
+      return i;
+    }
+
+#ifdef NM_X86
+    // the lookup algorithm of Keiser & Lemire, "Validating UTF-8 In Less Than One Instruction Per Byte". every
+    // byte is classified by the high nibble of the previous byte, its low nibble and the high nibble of the byte
+    // itself, a bit that survives in all three lookups is an error in the 2 bytes sequence ending at that byte
+    enum Error : uint8_t
     {
-      B0 = 6,
-      B1 = 7,
-      B2 = 5,
-      B3 = 4,
-      B4 = 3
+      kTooShort = 1 << 0,     // 11______ 0_______ or 11______ 11______
+      kTooLong = 1 << 1,      // 0_______ 10______
+      kOverlong3 = 1 << 2,    // 11100000 100_____
+      kTooLarge = 1 << 3,     // 11110100 1001____, 11110100 101_____, 11110101 ... 11111___
+      kSurrogate = 1 << 4,    // 11101101 101_____
+      kOverlong2 = 1 << 5,    // 1100000_ 10______
+      kTooLarge1000 = 1 << 6, // 11110101 1000____ ... 11111___ 1000____
+      kOverlong4 = 1 << 6,    // 11110000 1000____
+      kTwoConts = 1 << 7,     // 10______ 10______, unless it's the 3rd or 4th byte of a sequence
+      kCarry = kTooShort | kTooLong | kTwoConts
     };
 
-    enum Value : unsigned char
+    // indexed by the high nibble of the previous byte
+    static const uint8_t* byte1_high()
+    {
+      alignas(16) static const uint8_t t[16] = {
+        kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong, kTooLong,
+        kTwoConts, kTwoConts, kTwoConts, kTwoConts,
+        kTooShort | kOverlong2,
+        kTooShort,
+        kTooShort | kOverlong3 | kSurrogate,
+        kTooShort | kTooLarge | kTooLarge1000 | kOverlong4
+      };
+      return t;
+    }
+
+    // indexed by the low nibble of the previous byte
+    static const uint8_t* byte1_low()
+    {
+      alignas(16) static const uint8_t t[16] = {
+        kCarry | kOverlong3 | kOverlong2 | kOverlong4,
+        kCarry | kOverlong2,
+        kCarry,
+        kCarry,
+        kCarry | kTooLarge,
+        kCarry | kTooLarge | kTooLarge1000,
+        kCarry | kTooLarge | kTooLarge1000,
+        kCarry | kTooLarge | kTooLarge1000,
+        kCarry | kTooLarge | kTooLarge1000,
+        kCarry | kTooLarge | kTooLarge1000,
+        kCarry | kTooLarge | kTooLarge1000,
+        kCarry | kTooLarge | kTooLarge1000,
+        kCarry | kTooLarge | kTooLarge1000,
+        kCarry | kTooLarge | kTooLarge1000 | kSurrogate,
+        kCarry | kTooLarge | kTooLarge1000,
+        kCarry | kTooLarge | kTooLarge1000
+      };
+      return t;
+    }
+
+    // indexed by the high nibble of the current byte
+    static const uint8_t* byte2_high()
     {
-      V0 = 0b10,
-      V1 = 0b0,
-      V2 = 0b110,
-      V3 = 0b1110,
-      V4 = 0b11110
+      alignas(16) static const uint8_t t[16] = {
+        kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort, kTooShort,
+        kTooLong | kOverlong2 | kTwoConts | kOverlong3 | kTooLarge1000 | kOverlong4,
+        kTooLong | kOverlong2 | kTwoConts | kOverlong3 | kTooLarge,
+        kTooLong | kOverlong2 | kTwoConts | kSurrogate | kTooLarge,
+        kTooLong | kOverlong2 | kTwoConts | kSurrogate | kTooLarge,
+        kTooShort, kTooShort, kTooShort, kTooShort
+      };
+      return t;
+    }
+
+    // a lead byte in the last 3 bytes whose sequence doesn't fit, checked only at the end of input
+    static const uint8_t* incomplete_max()
+    {
+      alignas(32) static const uint8_t t[32] = {
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xf0 - 1, 0xe0 - 1, 0xc0 - 1
+      };
+      return t;
+    }
+
+    struct Sse
+    {
+      __m128i error;
+      __m128i prev;
+      __m128i incomplete;
+
+      NM_TARGET("sse4.1") static __m128i lookup(const uint8_t* t, __m128i idx)
+      {
+        return _mm_shuffle_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(t)), idx);
+      }
+
+      NM_TARGET("sse4.1") static __m128i high_nibble(__m128i x)
+      {
+        return _mm_and_si128(_mm_srli_epi16(x, 4), _mm_set1_epi8(0x0f));
+      }
+
+      NM_TARGET("sse4.1") void check(__m128i in)
+      {
+        auto prev1 = _mm_alignr_epi8(in, prev, 15);
+        auto sc = _mm_and_si128(_mm_and_si128(lookup(byte1_high(), high_nibble(prev1)),
+                                              lookup(byte1_low(), _mm_and_si128(prev1, _mm_set1_epi8(0x0f)))),
+                                lookup(byte2_high(), high_nibble(in)));
+        // 10______ 10______ is fine when it's the 3rd or 4th byte of a 3/4 bytes sequence
+        auto prev2 = _mm_alignr_epi8(in, prev, 14);
+        auto prev3 = _mm_alignr_epi8(in, prev, 13);
+        auto must23 = _mm_or_si128(_mm_subs_epu8(prev2, _mm_set1_epi8(static_cast<char>(0xe0 - 0x80))),
+                                   _mm_subs_epu8(prev3, _mm_set1_epi8(static_cast<char>(0xf0 - 0x80))));
+        auto must23_80 = _mm_and_si128(must23, _mm_set1_epi8(static_cast<char>(0x80)));
+        error = _mm_or_si128(error, _mm_xor_si128(must23_80, sc));
+        prev = in;
+      }
+
+      NM_TARGET("sse4.1") void check64(const char* s)
+      {
+        auto a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+        auto b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 16));
+        auto c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 32));
+        auto d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 48));
+        if(_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d))) == 0)
+        {
+          // all ASCII, only a sequence left open by the previous block can be wrong
+          error = _mm_or_si128(error, incomplete);
+          return;
+        }
+        check(a);
+        check(b);
+        check(c);
+        check(d);
+        incomplete = _mm_subs_epu8(d, _mm_loadu_si128(reinterpret_cast<const __m128i*>(incomplete_max() + 16)));
+      }
+    };
+
+    struct Avx
+    {
+      __m256i error;
+      __m256i prev;
+      __m256i incomplete;
+
+      NM_TARGET("avx2") static __m256i lookup(const uint8_t* t, __m256i idx)
+      {
+        return _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(t))),
+                                   idx);
+      }
+
+      NM_TARGET("avx2") static __m256i high_nibble(__m256i x)
+      {
+        return _mm256_and_si256(_mm256_srli_epi16(x, 4), _mm256_set1_epi8(0x0f));
+      }
+
+      NM_TARGET("avx2") void check(__m256i in)
+      {
+        // the upper half of `prev` followed by the lower half of `in`, so alignr works across the lanes
+        auto cross = _mm256_permute2x128_si256(prev, in, 0x21);
+        auto prev1 = _mm256_alignr_epi8(in, cross, 15);
+        auto sc = _mm256_and_si256(_mm256_and_si256(lookup(byte1_high(), high_nibble(prev1)),
+                                                    lookup(byte1_low(), _mm256_and_si256(prev1, _mm256_set1_epi8(0x0f)))),
+                                   lookup(byte2_high(), high_nibble(in)));
+        auto prev2 = _mm256_alignr_epi8(in, cross, 14);
+        auto prev3 = _mm256_alignr_epi8(in, cross, 13);
+        auto must23 = _mm256_or_si256(_mm256_subs_epu8(prev2, _mm256_set1_epi8(static_cast<char>(0xe0 - 0x80))),
+                                      _mm256_subs_epu8(prev3, _mm256_set1_epi8(static_cast<char>(0xf0 - 0x80))));
+        auto must23_80 = _mm256_and_si256(must23, _mm256_set1_epi8(static_cast<char>(0x80)));
+        error = _mm256_or_si256(error, _mm256_xor_si256(must23_80, sc));
+        prev = in;
+      }
+
+      NM_TARGET("avx2") void check64(const char* s)
+      {
+        auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s));
+        auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + 32));
+        if(_mm256_movemask_epi8(_mm256_or_si256(a, b)) == 0)
+        {
+          error = _mm256_or_si256(error, incomplete);
+          return;
+        }
+        check(a);
+        check(b);
+        incomplete = _mm256_subs_epu8(b, _mm256_load_si256(reinterpret_cast<const __m256i*>(incomplete_max())));
+      }
     };
+#endif
 
-    static bool test(unsigned char n, Type width, Value expected)
+    static validate_fn select_kernel()
     {
-      n >>= width;
-      return n == expected;
+#ifdef NM_X86
+      auto& c = nm::cpu();
+      if(c.avx2)
+      {
+        return validate_avx2;
+      }
+      if(c.sse41)
+      {
+        return validate_sse41;
+      }
+#endif
+      return validate_scalar;
+    }
+
+    // bytes in the sequence started by lead byte `x`, 0 when `x` can't start a sequence
+    static size_t width(unsigned char x)
+    {
+      if(x >= 0xc2 && x <= 0xdf)
+      {
+        return 2;
+      }
+      if(x >= 0xe0 && x <= 0xef)
+      {
+        return 3;
+      }
+      if(x >= 0xf0 && x <= 0xf4)
+      {
+        return 4;
+      }
+      return 0;
+    }
+
+    // range of the byte following lead byte `x`
+    static void second_range(unsigned char x, unsigned char& lo, unsigned char& hi)
+    {
+      lo = x == 0xe0 ? 0xa0 : x == 0xf0 ? 0x90 : 0x80; // overlong
+      hi = x == 0xed ? 0x9f : x == 0xf4 ? 0x8f : 0xbf; // surrogate, above U+10FFFF
     }
 
   public:
-    static bool validate(const char* s, size_t len)
+    // validates a text split at arbitrary points, a code point cut by a split is carried over to the next feed
+    class Stream
     {
-      int width = 0;
-      bool is_first = true;
-      for(size_t i = 0; i < len;)
+    public:
+      void reset() { len_ = 0; }
+
+      // false as soon as the input so far can't be the beginning of a valid text
+      bool feed(const char* s, size_t n)
       {
-        unsigned char x = s[i];
-        if(is_first)
+        if(len_ > 0)
         {
-          is_first = false;
-          if(test(x, B1, V1))
+          size_t want = width(tail_[0]) - len_;
+          size_t k = want < n ? want : n;
+          std::memcpy(tail_ + len_, s, k);
+          len_ += k;
+          s += k;
+          n -= k;
+          if(k < want)
           {
-            i += 1;
-            is_first = true;
+            return this->is_prefix();
           }
-          else if(test(x, B2, V2))
-          {
-            width = 1;
-          }
-          else if(test(x, B3, V3))
-          {
-            width = 2;
-          }
-          else if(test(x, B4, V4))
-          {
-            width = 3;
-          }
-          else
+          if(!validate_scalar(tail_, len_))
           {
             return false;
           }
+          len_ = 0;
         }
-        else
+        size_t cut = last_boundary(s, n);
+        if(cut < n && n - cut >= width(s[cut]))
         {
-          while(width-- && i + 1 < len)
-          {
-            i += 1;
-            x = s[i];
-            if(!test(x, B0, V0))
-            {
-              return false;
-            }
-          }
+          cut = n; // the last code point is complete, or the lead byte is invalid
+        }
+        if(!validate(s, cut))
+        {
+          return false;
+        }
+        len_ = n - cut;
+        std::memcpy(tail_, s + cut, len_);
+        return this->is_prefix();
+      }
+
+      // the end of text, nothing may be left over
+      bool finish() const { return len_ == 0; }
+
+    private:
+      char tail_[4];
+      size_t len_{0};
+
+      bool is_prefix() const
+      {
+        if(len_ == 0)
+        {
+          return true;
+        }
+        auto s = reinterpret_cast<const unsigned char*>(tail_);
+        unsigned char lo, hi;
+        second_range(s[0], lo, hi);
+        if(width(s[0]) == 0 || (len_ > 1 && (s[1] < lo || s[1] > hi)))
+        {
+          return false;
+        }
+        return len_ < 3 || is_cont(s[2]);
+      }
+    };
+
+    // position of the last lead byte if the code point it starts may continue past `len`, otherwise `len`
+    static size_t last_boundary(const char* s, size_t len)
+    {
+      for(size_t i = 1; i <= 4 && i <= len; ++i)
+      {
+        unsigned char x = s[len - i];
+        if(!is_cont(x))
+        {
+          return x >= 0xc0u ? len - i : len;
+        }
+      }
+      return len;
+    }
 
-          i += 1;
-          is_first = true;
-          if(i >= len)
+    // well-formed byte sequences, table 3-7 of the unicode standard
+    static bool validate_scalar(const char* str, size_t len)
+    {
+      auto s = reinterpret_cast<const unsigned char*>(str);
+      for(size_t i = 0; i < len;)
+      {
+        i += ascii_prefix(str + i, len - i);
+        if(i >= len)
+        {
+          break;
+        }
+        unsigned char x = s[i];
+        size_t w = width(x);
+        unsigned char lo, hi;
+        second_range(x, lo, hi);
+        if(w == 0 || len - i < w || s[i + 1] < lo || s[i + 1] > hi)
+        {
+          return false;
+        }
+        for(size_t k = 2; k < w; ++k)
+        {
+          if(!is_cont(s[i + k]))
           {
-            break;
+            return false;
           }
         }
+        i += w;
       }
       return true;
     }
+
+#ifdef NM_X86
+    NM_TARGET("sse4.1") static bool validate_sse41(const char* s, size_t len)
+    {
+      Sse v{_mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128()};
+      size_t i = 0;
+      for(; i + 64 <= len; i += 64)
+      {
+        v.check64(s + i);
+      }
+      if(i < len)
+      {
+        // zero padding is ASCII, a sequence cut by the end is reported as too short
+        alignas(16) char tail[64] = {};
+        std::memcpy(tail, s + i, len - i);
+        v.check64(tail);
+      }
+      auto e = _mm_or_si128(v.error, v.incomplete);
+      return _mm_testz_si128(e, e) != 0;
+    }
+
+    NM_TARGET("avx2") static bool validate_avx2(const char* s, size_t len)
+    {
+      Avx v{_mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256()};
+      size_t i = 0;
+      for(; i + 64 <= len; i += 64)
+      {
+        v.check64(s + i);
+      }
+      if(i < len)
+      {
+        alignas(32) char tail[64] = {};
+        std::memcpy(tail, s + i, len - i);
+        v.check64(tail);
+      }
+      auto e = _mm256_or_si256(v.error, v.incomplete);
+      return _mm256_testz_si256(e, e) != 0;
+    }
+#endif
+
+    static bool validate(const char* s, size_t len)
+    {
+      static const validate_fn kernel = select_kernel();
+      // short messages don't amortize the vector setup
+      if(len < 64)
+      {
+        return validate_scalar(s, len);
+      }
+      return kernel(s, len);
+    }
   };
 }
 
@@ -0,0 +1,338 @@
+/*********************************************************
+          File Name: zstd.h
+          Author: Abby Cin
+          Mail: abbytsing@gmail.com
+          Created Time: Sun 18 Oct 2026 09:12:33 PM CST
+**********************************************************/
+
+#ifndef WS_ZSTD_H
+#define WS_ZSTD_H
+
+#include <cerrno>
+#include <cstdio>
+#include <map>
+#include <zstd.h>
+
+namespace ws
+{
+  // a zstd dictionary trained offline on messages of the application, e.g. with `zstd --train`. it's immutable and
+  // shared by every connection using it
+  class zstd_dictionary
+  {
+  public:
+    // dictionaries from the same file at the same level are loaded once per process, as long as one is in use
+    static std::shared_ptr<const zstd_dictionary> load(const std::string& path, int level, std::error_code& ec)
+    {
+      static std::mutex mtx;
+      static std::map<std::pair<std::string, int>, std::weak_ptr<const zstd_dictionary>> loaded;
+
+      std::lock_guard<std::mutex> lg{mtx};
+      auto& w = loaded[{path, level}];
+      auto r = w.lock();
+      if(r)
+      {
+        ec.clear();
+        return r;
+      }
+      std::string content;
+      if(!read_file(path, content, ec))
+      {
+        return nullptr;
+      }
+      r = create(std::move(content), level, ec);
+      w = r;
+      return r;
+    }
+
+    // `content` is the dictionary file as is, its id must not be 0 since it's what peers agree on
+    static std::shared_ptr<const zstd_dictionary> create(std::string content, int level, std::error_code& ec)
+    {
+      std::shared_ptr<zstd_dictionary> r{new zstd_dictionary{std::move(content), level}};
+      if(r->id_ == 0 || r->cdict_ == nullptr || r->ddict_ == nullptr)
+      {
+        ec = make_error_code(ws_error::invalid_dictionary);
+        return nullptr;
+      }
+      ec.clear();
+      return r;
+    }
+
+    ~zstd_dictionary()
+    {
+      ::ZSTD_freeCDict(cdict_);
+      ::ZSTD_freeDDict(ddict_);
+    }
+
+    zstd_dictionary(const zstd_dictionary&) = delete;
+
+    zstd_dictionary& operator=(const zstd_dictionary&) = delete;
+
+    uint32_t id() const { return id_; }
+
+    int level() const { return level_; }
+
+    const ZSTD_CDict* cdict() const { return cdict_; }
+
+    const ZSTD_DDict* ddict() const { return ddict_; }
+
+  private:
+    std::string content_; // ddict_ refers to it
+    int level_;
+    uint32_t id_;
+    ZSTD_CDict* cdict_;
+    ZSTD_DDict* ddict_;
+
+    zstd_dictionary(std::string content, int level)
+        : content_{std::move(content)}, level_{level},
+          id_{::ZSTD_getDictID_fromDict(content_.data(), content_.size())},
+          cdict_{::ZSTD_createCDict(content_.data(), content_.size(), level)},
+          ddict_{::ZSTD_createDDict_byReference(content_.data(), content_.size())}
+    {
+    }
+
+    static bool read_file(const std::string& path, std::string& content, std::error_code& ec)
+    {
+      auto fp = ::fopen(path.c_str(), "rb");
+      if(fp == nullptr)
+      {
+        ec = std::error_code{errno, std::generic_category()};
+        return false;
+      }
+      char buf[4096];
+      size_t n;
+      while((n = ::fread(buf, 1, sizeof(buf), fp)) > 0)
+      {
+        content.append(buf, n);
+      }
+      bool ok = !::ferror(fp);
+      ::fclose(fp);
+      if(!ok)
+      {
+        ec = std::error_code{EIO, std::generic_category()};
+      }
+      return ok;
+    }
+  };
+
+  namespace detail
+  {
+    // a message is (de)compressed in one call, so a thread reuses the same contexts for every connection
+    class ZstdContexts
+    {
+    public:
+      ZstdContexts() = default;
+
+      ~ZstdContexts()
+      {
+        ::ZSTD_freeCCtx(c_);
+        ::ZSTD_freeDCtx(d_);
+      }
+
+      ZstdContexts(const ZstdContexts&) = delete;
+
+      ZstdContexts& operator=(const ZstdContexts&) = delete;
+
+      static ZstdContexts& local()
+      {
+        thread_local ZstdContexts ctx;
+        return ctx;
+      }
+
+      ZSTD_CCtx* cctx()
+      {
+        if(c_ == nullptr)
+        {
+          c_ = ::ZSTD_createCCtx();
+        }
+        return c_;
+      }
+
+      ZSTD_DCtx* dctx()
+      {
+        if(d_ == nullptr)
+        {
+          d_ = ::ZSTD_createDCtx();
+        }
+        return d_;
+      }
+
+    private:
+      ZSTD_CCtx* c_{nullptr};
+      ZSTD_DCtx* d_{nullptr};
+    };
+  }
+
+  // x-permessage-zstd, every message is an independent zstd frame compressed with a dictionary both sides agreed on
+  // through `dict_id`. a client offers its first dictionary, a server accepts an offer whose dictionary it has. no
+  // dict_id means plain zstd at `level`. it uses rsv1 like permessage-deflate, offer both and the server picks one
+  class permessage_zstd : public extension
+  {
+  public:
+    explicit permessage_zstd(std::vector<std::shared_ptr<const zstd_dictionary>> dicts = {},
+                             int level = ZSTD_CLEVEL_DEFAULT)
+        : dicts_{std::move(dicts)}, level_{level}
+    {
+    }
+
+    // the dictionary in use, nullptr for plain zstd
+    const std::shared_ptr<const zstd_dictionary>& dictionary() const { return dict_; }
+
+    nm::string_view name() const override { return "x-permessage-zstd"; }
+
+    uint8_t rsv_bits() const override { return detail::kRsv1; }
+
+    void offer(std::string& params) override
+    {
+      if(!dicts_.empty())
+      {
+        params.append("; dict_id=").append(std::to_string(dicts_.front()->id()));
+      }
+    }
+
+    bool confirm(const ext_params& params) override
+    {
+      uint32_t id = 0;
+      if(!parse(params, id) || id != (dicts_.empty() ? 0 : dicts_.front()->id()))
+      {
+        return false;
+      }
+      dict_ = dicts_.empty() ? nullptr : dicts_.front();
+      return true;
+    }
+
+    bool accept(const ext_params& params, std::string& response) override
+    {
+      uint32_t id = 0;
+      if(!parse(params, id))
+      {
+        return false;
+      }
+      dict_ = nullptr;
+      if(id != 0)
+      {
+        for(auto& d: dicts_)
+        {
+          if(d->id() == id)
+          {
+            dict_ = d;
+          }
+        }
+        if(!dict_)
+        {
+          return false;
+        }
+        response.append("; dict_id=").append(std::to_string(id));
+      }
+      return true;
+    }
+
+    uint8_t encode(detail::opcode, const Buffer& in, detail::Message& out) override
+    {
+      auto cctx = detail::ZstdContexts::local().cctx();
+      if(cctx == nullptr)
+      {
+        return 0;
+      }
+      auto n = in.readable_size();
+      out.make_space(::ZSTD_compressBound(n));
+      ::ZSTD_CCtx_reset(cctx, ZSTD_reset_session_and_parameters);
+      // the peer decodes with a window of at most kMaxWindowLog, which levels above 19 exceed on large messages
+      ::ZSTD_CCtx_setParameter(cctx, ZSTD_c_windowLog, kMaxWindowLog);
+      if(dict_)
+      {
+        ::ZSTD_CCtx_refCDict(cctx, dict_->cdict());
+      }
+      else
+      {
+        ::ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level_);
+      }
+      auto r = ::ZSTD_compress2(cctx, out.begin_write(), out.writable_size(), in.peek(), n);
+      // nothing depends on this message, so one that doesn't shrink is sent as is
+      if(::ZSTD_isError(r) || r >= n)
+      {
+        return 0;
+      }
+      out.write(r);
+      return detail::kRsv1;
+    }
+
+    std::error_code decode(const Buffer& in, detail::Message& out, size_t limit) override
+    {
+      auto dctx = detail::ZstdContexts::local().dctx();
+      if(dctx == nullptr)
+      {
+        return make_error_code(ws_error::inflate_failed);
+      }
+      ::ZSTD_DCtx_reset(dctx, ZSTD_reset_session_and_parameters);
+      ::ZSTD_DCtx_setParameter(dctx, ZSTD_d_windowLogMax, kMaxWindowLog);
+      ::ZSTD_DCtx_refDDict(dctx, dict_ ? dict_->ddict() : nullptr);
+
+      ZSTD_inBuffer src{in.peek(), in.readable_size(), 0};
+      size_t r = 0;
+      do
+      {
+        out.make_space(kChunk);
+        ZSTD_outBuffer dst{out.begin_write(), out.writable_size(), 0};
+        r = ::ZSTD_decompressStream(dctx, &dst, &src);
+        if(::ZSTD_isError(r))
+        {
+          return make_error_code(ws_error::inflate_failed);
+        }
+        out.write(dst.pos);
+        if(out.readable_size() > limit)
+        {
+          return make_error_code(ws_error::payload_too_big);
+        }
+        if(r != 0 && src.pos == src.size && dst.pos < dst.size)
+        {
+          return make_error_code(ws_error::inflate_failed); // truncated frame
+        }
+      } while(r != 0 || src.pos < src.size);
+      return {};
+    }
+
+    int64_t encoding_id() const override
+    {
+      return dict_ ? (int64_t{1} << 32) | dict_->id() : static_cast<int64_t>(level_ + 128);
+    }
+
+  private:
+    constexpr static size_t kChunk = 4096;
+    constexpr static int kMaxWindowLog = 23; // 8MB, zstd allows 128MB by default
+
+    std::vector<std::shared_ptr<const zstd_dictionary>> dicts_;
+    std::shared_ptr<const zstd_dictionary> dict_;
+    int level_;
+
+    // dict_id at most once, 0 when absent
+    static bool parse(const ext_params& params, uint32_t& id)
+    {
+      bool seen = false;
+      for(auto& x: params)
+      {
+        if(x.name != "dict_id" || seen || x.value.empty() || x.value.size() > 10)
+        {
+          return false;
+        }
+        uint64_t v = 0;
+        for(size_t i = 0; i < x.value.size(); ++i)
+        {
+          if(x.value[i] < '0' || x.value[i] > '9')
+          {
+            return false;
+          }
+          v = v * 10 + static_cast<uint64_t>(x.value[i] - '0');
+        }
+        if(v == 0 || v > UINT32_MAX)
+        {
+          return false;
+        }
+        id = static_cast<uint32_t>(v);
+        seen = true;
+      }
+      return true;
+    }
+  };
+}
+
+#endif // WS_ZSTD_H
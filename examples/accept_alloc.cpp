@@ -0,0 +1,163 @@
+/*********************************************************
+          File Name: accept_alloc.cpp
+          Author: Abby Cin
+          Mail: abbytsing@gmail.com
+          Created Time: Sun 18 Oct 2026 03:40:12 PM CST
+**********************************************************/
+
+#include "asio.hpp"
+#include "websocket.h"
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+// counts the heap allocations of accept(), from the call to its handler, on an upgrade request already read and on
+// one read from the socket, with and without a subprotocol to negotiate. asio recycles the memory of completed
+// handlers on the io_context thread, so after the first connections an accept should allocate nothing. exits with 1
+// when it does. a negotiated extension is out of scope, its parameters and response are built in strings
+
+using sock_t = ws::stream<asio::ip::tcp::socket, ws::role::server>;
+
+static size_t g_allocs = 0;
+static bool g_counting = false;
+
+void* operator new(size_t n)
+{
+  if(g_counting)
+  {
+    g_allocs += 1;
+  }
+  auto p = std::malloc(n == 0 ? 1 : n);
+  if(p == nullptr)
+  {
+    throw std::bad_alloc{};
+  }
+  return p;
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+#define REQUEST_HEAD                                                                                                   \
+  "GET /chat HTTP/1.1\r\n"                                                                                             \
+  "Host: 127.0.0.1:8889\r\n"                                                                                           \
+  "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:128.0) Gecko/20100101 Firefox/128.0\r\n"                             \
+  "Accept: */*\r\n"                                                                                                    \
+  "Accept-Language: en-US,en;q=0.5\r\n"                                                                                \
+  "Accept-Encoding: gzip, deflate, br\r\n"                                                                             \
+  "Sec-WebSocket-Version: 13\r\n"                                                                                      \
+  "Origin: http://127.0.0.1:8889\r\n"                                                                                  \
+  "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"                                                                    \
+  "Connection: keep-alive, Upgrade\r\n"                                                                                \
+  "Pragma: no-cache\r\n"                                                                                               \
+  "Cache-Control: no-cache\r\n"                                                                                        \
+  "Upgrade: websocket\r\n"
+
+static const char kRequest[] = REQUEST_HEAD "\r\n";
+static const char kProtocolRequest[] = REQUEST_HEAD "Sec-WebSocket-Protocol: superchat, chat\r\n\r\n";
+
+struct Case
+{
+  const char* name;
+  const char* request;
+  size_t size;
+  bool from_socket; // accept(cb) reads the request, otherwise it's passed to accept(data, cb)
+};
+
+// allocations per accepted connection of `c`, averaged over `rounds` after `warm_up`, -1 on error
+static double run(asio::io_context& ioc, asio::ip::tcp::acceptor& acceptor, const Case& c, int warm_up, int rounds,
+                  size_t& worst)
+{
+  size_t total = 0;
+  worst = 0;
+  for(int i = 0; i < warm_up + rounds; ++i)
+  {
+    asio::ip::tcp::socket peer{ioc};
+    sock_t srv{ioc};
+    srv.set_subprotocols({"chat"});
+    peer.connect(acceptor.local_endpoint());
+    acceptor.accept(srv.next_layer());
+    if(c.from_socket)
+    {
+      std::error_code ec;
+      asio::write(peer, asio::buffer(c.request, c.size), ec);
+      if(ec)
+      {
+        std::cerr << c.name << ": write: " << ec.message() << '\n';
+        return -1;
+      }
+    }
+
+    // called from a handler, as a server does once it read the request. the callback is small enough for
+    // std::function to keep it in place
+    struct
+    {
+      bool done;
+      std::error_code ec;
+    } res{false, {}};
+    asio::post(ioc, [&srv, &res, &c] {
+      auto cb = [&res](http::header&, const std::error_code& ec) {
+        g_counting = false;
+        res.done = true;
+        res.ec = ec;
+      };
+      g_allocs = 0;
+      g_counting = true;
+      if(c.from_socket)
+      {
+        srv.accept(cb);
+      }
+      else
+      {
+        srv.accept(ws::buffer(c.request, c.size), cb);
+      }
+    });
+    while(!res.done)
+    {
+      ioc.run_one();
+    }
+    if(res.ec)
+    {
+      std::cerr << c.name << ": accept: " << res.ec.message() << '\n';
+      return -1;
+    }
+    if(i >= warm_up)
+    {
+      total += g_allocs;
+      worst = std::max(worst, g_allocs);
+    }
+    // the ping timer is cancelled and its handler run, so its memory is back for the next connection
+    srv.force_close();
+    ioc.run();
+    ioc.restart();
+  }
+  return static_cast<double>(total) / rounds;
+}
+
+int main()
+{
+  constexpr int kWarmUp = 2;
+  constexpr int kRounds = 100;
+  const Case cases[] = {
+    {"accept(data, cb)", kRequest, sizeof(kRequest) - 1, false},
+    {"accept(cb)", kRequest, sizeof(kRequest) - 1, true},
+    {"accept(cb) with a subprotocol", kProtocolRequest, sizeof(kProtocolRequest) - 1, true},
+  };
+  asio::io_context ioc;
+  asio::ip::tcp::acceptor acceptor{ioc, asio::ip::tcp::endpoint{asio::ip::address_v4::loopback(), 0}};
+  bool ok = true;
+  for(auto& c: cases)
+  {
+    size_t worst = 0;
+    auto n = run(ioc, acceptor, c, kWarmUp, kRounds, worst);
+    if(n < 0)
+    {
+      return 1;
+    }
+    std::cout << c.name << ": allocations per accepted connection: " << n << " (worst " << worst << ")\n";
+    ok = ok && n == 0;
+  }
+  return ok ? 0 : 1;
+}
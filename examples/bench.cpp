@@ -0,0 +1,794 @@
+/*********************************************************
+          File Name: bench.cpp
+          Author: Abby Cin
+          Mail: abbytsing@gmail.com
+          Created Time: Sun 18 Oct 2026 11:20:45 AM CST
+**********************************************************/
+
+#include "asio.hpp"
+#include "websocket.h"
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+#ifdef WS_WITH_ZSTD
+#include <fstream>
+#include <zdict.h>
+#endif
+
+using namespace std::chrono;
+
+// keeps results alive that are otherwise never read
+volatile unsigned char sink;
+
+// run `f` over `n` bytes until roughly `total` bytes are processed, return GB/s
+template<typename F>
+static double throughput(size_t n, F&& f, size_t total = size_t(1) << 30)
+{
+  size_t rounds = total / n;
+  if(rounds == 0)
+  {
+    rounds = 1;
+  }
+  f(); // warm up
+  auto b = high_resolution_clock::now();
+  for(size_t i = 0; i < rounds; ++i)
+  {
+    f();
+  }
+  auto e = high_resolution_clock::now();
+  auto sec = duration_cast<nanoseconds>(e - b).count() / 1'000'000'000.0;
+  return static_cast<double>(rounds * n) / sec / 1'000'000'000.0;
+}
+
+static void print_row(const std::string& name, const std::vector<double>& v)
+{
+  std::cout << std::setw(10) << std::left << name;
+  for(auto x: v)
+  {
+    std::cout << std::setw(10) << std::right << std::fixed << std::setprecision(2) << x;
+  }
+  std::cout << '\n';
+}
+
+static void print_sizes(const std::string& title, const std::vector<size_t>& sizes)
+{
+  std::cout << '\n' << std::setw(10) << std::left << title;
+  for(auto s: sizes)
+  {
+    std::string x = s >= (1 << 20) ? std::to_string(s >> 20) + "M" : s >= 1024 ? std::to_string(s >> 10) + "K" :
+                                                                                   std::to_string(s);
+    std::cout << std::setw(10) << std::right << x;
+  }
+  std::cout << "   (GB/s)\n";
+}
+
+static void bench_mask()
+{
+  struct Kernel
+  {
+    const char* name;
+    ws::detail::mask_fn fn;
+    bool supported;
+  };
+  std::vector<Kernel> kernels{{"scalar", ws::detail::mask_scalar, true}};
+#ifdef NM_X86
+  auto& cpu = nm::cpu();
+  kernels.push_back({"sse2", ws::detail::mask_sse2, cpu.sse2});
+  kernels.push_back({"avx2", ws::detail::mask_avx2, cpu.avx2});
+  kernels.push_back({"avx512", ws::detail::mask_avx512, cpu.avx512bw});
+#endif
+
+  std::vector<size_t> sizes;
+  for(size_t n = 16; n <= (16u << 20); n *= 4)
+  {
+    sizes.push_back(n);
+  }
+  // payload starts right after a 6 bytes masked frame header, so it's never aligned
+  std::vector<char> buf(sizes.back() + 64, 'x');
+  char* data = buf.data() + 6;
+
+  print_sizes("mask", sizes);
+  for(auto& k: kernels)
+  {
+    if(!k.supported)
+    {
+      continue;
+    }
+    std::vector<double> row;
+    for(auto n: sizes)
+    {
+      row.push_back(throughput(n, [&] { k.fn(data, n, 0x12345678u); }));
+    }
+    print_row(k.name, row);
+  }
+}
+
+// what build_write_buffer does for a client frame: copy then mask in place, or mask while copying
+static void bench_mask_copy()
+{
+  std::vector<size_t> sizes;
+  for(size_t n = 16; n <= (16u << 20); n *= 4)
+  {
+    sizes.push_back(n);
+  }
+  std::vector<char> src(sizes.back() + 64, 'x');
+  std::vector<char> dst(sizes.back() + 64);
+  char* out = dst.data() + 6;
+
+  print_sizes("mask copy", sizes);
+  std::vector<double> row;
+  for(auto n: sizes)
+  {
+    row.push_back(throughput(n, [&] {
+      std::memcpy(out, src.data(), n);
+      ws::detail::mask(out, n, 0x12345678u);
+    }));
+  }
+  print_row("two pass", row);
+  row.clear();
+  for(auto n: sizes)
+  {
+    row.push_back(throughput(n, [&] { ws::detail::mask_copy(out, src.data(), n, 0x12345678u); }));
+  }
+  print_row("fused", row);
+}
+
+// client side frame encoding (header with a fresh mask key + masked payload) on 1..N threads
+static void bench_encode()
+{
+  constexpr size_t payload_size = 128;
+  constexpr size_t frames = 4'000'000;
+  size_t max_threads = std::max(1u, std::thread::hardware_concurrency());
+  std::string payload(payload_size, 'x');
+
+  std::cout << "\nencode " << payload_size << " bytes frames  (M frames/s)\n";
+  for(size_t n = 1; n <= max_threads; n *= 2)
+  {
+    std::vector<std::thread> workers;
+    auto b = high_resolution_clock::now();
+    for(size_t t = 0; t < n; ++t)
+    {
+      workers.emplace_back([&payload] {
+        std::vector<char> out(payload_size + 14);
+        for(size_t i = 0; i < frames; ++i)
+        {
+          ws::detail::WsFrame f{};
+          f.set_fin();
+          f.set_mask(true);
+          f.set_code(ws::detail::opcode::binary);
+          f.set_payload_size(payload.size());
+          auto len = f.build(out.data());
+          ws::detail::mask_copy(out.data() + len, payload.data(), payload.size(), f.mask_key());
+        }
+      });
+    }
+    for(auto& w: workers)
+    {
+      w.join();
+    }
+    auto e = high_resolution_clock::now();
+    auto sec = duration_cast<nanoseconds>(e - b).count() / 1'000'000'000.0;
+    std::cout << std::setw(10) << std::left << (std::to_string(n) + " thread") << std::setw(10) << std::right
+              << std::fixed << std::setprecision(2) << static_cast<double>(n * frames) / sec / 1'000'000.0 << '\n';
+  }
+}
+
+// at least `n` bytes of text out of `pieces`, a prefix is cut with UTF8::last_boundary
+static std::string make_corpus(const std::vector<std::string>& pieces, size_t n)
+{
+  std::string r;
+  for(size_t i = 0; r.size() < n; i = (i * 7 + 3) % pieces.size())
+  {
+    r += pieces[i];
+  }
+  return r;
+}
+
+static void bench_utf8()
+{
+  struct Kernel
+  {
+    const char* name;
+    bool (*fn)(const char*, size_t);
+    bool supported;
+  };
+  std::vector<Kernel> kernels{{"scalar", nm::UTF8::validate_scalar, true}};
+#ifdef NM_X86
+  auto& cpu = nm::cpu();
+  kernels.push_back({"sse4.1", nm::UTF8::validate_sse41, cpu.sse41});
+  kernels.push_back({"avx2", nm::UTF8::validate_avx2, cpu.avx2});
+#endif
+
+  struct Corpus
+  {
+    const char* name;
+    std::vector<std::string> pieces;
+  };
+  std::vector<Corpus> corpora{
+    {"ascii", {"{\"id\":1024,", "\"user\":\"abby\",", "\"text\":\"hello world\"}", "\n"}},
+    {"cjk", {"{\"text\":\"", "\xe4\xbd\xa0\xe5\xa5\xbd", "\xe4\xb8\x96\xe7\x95\x8c", "abc", "\"}"}},
+    {"emoji", {"\xf0\x9f\x98\x80", "\xf0\x9f\x91\x8d", " ok ", "\xe2\x9c\x85", "\xc3\xa9"}},
+  };
+
+  std::vector<size_t> sizes;
+  for(size_t n = 64; n <= (1u << 20); n *= 4)
+  {
+    sizes.push_back(n);
+  }
+  for(auto& c: corpora)
+  {
+    auto text = make_corpus(c.pieces, sizes.back());
+    print_sizes(c.name, sizes);
+    for(auto& k: kernels)
+    {
+      if(!k.supported)
+      {
+        continue;
+      }
+      std::vector<double> row;
+      for(auto n: sizes)
+      {
+        size_t len = nm::UTF8::last_boundary(text.data(), n);
+        row.push_back(throughput(len, [&] {
+          if(!k.fn(text.data(), len))
+          {
+            std::abort();
+          }
+        }));
+      }
+      print_row(k.name, row);
+    }
+  }
+}
+
+// the accept key of a handshake (24 bytes key + GUID, 2 blocks after padding) and bulk hashing
+static void bench_sha1()
+{
+  struct Kernel
+  {
+    const char* name;
+    void (*fn)(uint32_t*, const uint8_t*, size_t);
+    bool supported;
+  };
+  std::vector<Kernel> kernels{{"scalar", nm::Sha1::compress_scalar, true}};
+#ifdef NM_X86
+  kernels.push_back({"sha-ni", nm::Sha1::compress_shani, nm::cpu().sha});
+#endif
+
+  std::vector<size_t> sizes{128, 1024, 16 << 10, 1 << 20};
+  std::vector<uint8_t> data(sizes.back(), 'x');
+  print_sizes("sha1", sizes);
+  for(auto& k: kernels)
+  {
+    if(!k.supported)
+    {
+      continue;
+    }
+    uint32_t h[5] = {};
+    std::vector<double> row;
+    for(auto n: sizes)
+    {
+      row.push_back(throughput(n, [&] { k.fn(h, data.data(), n / 64); }, size_t(1) << 28));
+    }
+    print_row(k.name, row);
+  }
+
+  constexpr size_t rounds = 2'000'000;
+  std::string key = "dGhlIHNhbXBsZSBub25jZQ==";
+  auto b = high_resolution_clock::now();
+  for(size_t i = 0; i < rounds; ++i)
+  {
+    unsigned char digest[nm::Sha1::DIGEST_SIZE];
+    key[0] = static_cast<char>('A' + i % 26);
+    nm::Sha1 sh;
+    sh.update(key.data(), key.size());
+    sh.update(http::GUID, sizeof(http::GUID) - 1);
+    sh.final(digest);
+    sink = digest[0];
+  }
+  auto e = high_resolution_clock::now();
+  auto sec = duration_cast<nanoseconds>(e - b).count() / 1'000'000'000.0;
+  std::cout << "\naccept key  " << std::fixed << std::setprecision(2) << rounds / sec / 1'000'000.0 << " M/s\n";
+}
+
+static void bench_base64()
+{
+  struct Kernel
+  {
+    const char* name;
+    nm::base64_encode_fn enc;
+    nm::base64_decode_fn dec;
+    bool supported;
+  };
+  std::vector<Kernel> kernels{{"scalar", nm::base64_encode_scalar, nm::base64_decode_scalar, true}};
+#ifdef NM_X86
+  auto& cpu = nm::cpu();
+  kernels.push_back({"ssse3", nm::base64_encode_ssse3, nm::base64_decode_ssse3, cpu.ssse3});
+  kernels.push_back({"avx2", nm::base64_encode_avx2, nm::base64_decode_avx2, cpu.avx2});
+#endif
+
+  std::vector<size_t> sizes{24, 1024, 16 << 10, 1 << 20};
+  std::vector<uint8_t> raw(sizes.back());
+  for(size_t i = 0; i < raw.size(); ++i)
+  {
+    raw[i] = static_cast<uint8_t>(i * 131 + 7);
+  }
+  std::string text(nm::base64_encode_size(raw.size()), '\0');
+  nm::base64_encode(&text[0], raw.data(), raw.size());
+  std::vector<uint8_t> out(nm::base64_decode_size(text.size()));
+
+  print_sizes("b64 encode", sizes);
+  for(auto& k: kernels)
+  {
+    if(!k.supported)
+    {
+      continue;
+    }
+    std::vector<double> row;
+    for(auto n: sizes)
+    {
+      row.push_back(throughput(n, [&] { k.enc(&text[0], raw.data(), n); }, size_t(1) << 28));
+    }
+    print_row(k.name, row);
+  }
+  print_sizes("b64 decode", sizes);
+  for(auto& k: kernels)
+  {
+    if(!k.supported)
+    {
+      continue;
+    }
+    std::vector<double> row;
+    for(auto n: sizes)
+    {
+      size_t len = nm::base64_encode_size(n / 3 * 3);
+      row.push_back(throughput(len, [&] { sink = static_cast<unsigned char>(k.dec(out.data(), text.data(), len)); },
+                               size_t(1) << 28));
+    }
+    print_row(k.name, row);
+  }
+}
+
+// parse a browser-like upgrade request
+static void bench_header()
+{
+  std::string req = "GET /chat HTTP/1.1\r\n"
+                    "Host: server.example.com\r\n"
+                    "Connection: keep-alive, Upgrade\r\n"
+                    "Pragma: no-cache\r\n"
+                    "Cache-Control: no-cache\r\n"
+                    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko)\r\n"
+                    "Upgrade: websocket\r\n"
+                    "Origin: http://example.com\r\n"
+                    "Sec-WebSocket-Version: 13\r\n"
+                    "Accept-Encoding: gzip, deflate, br\r\n"
+                    "Accept-Language: en-US,en;q=0.9\r\n"
+                    "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                    "Sec-WebSocket-Extensions: permessage-deflate; client_max_window_bits\r\n"
+                    "\r\n";
+  constexpr size_t rounds = 2'000'000;
+  // the same request arriving at once and in `step` bytes pieces, the parser resumes so the cost stays flat
+  std::cout << "\nupgrade request (" << req.size() << " bytes)\n";
+  for(size_t step: {req.size(), size_t(64), size_t(8), size_t(1)})
+  {
+    size_t n = step == 1 ? rounds / 16 : rounds;
+    auto b = high_resolution_clock::now();
+    for(size_t i = 0; i < n; ++i)
+    {
+      http::header h;
+      auto r = http::header_error::more;
+      for(size_t len = step; r == http::header_error::more; len += step)
+      {
+        r = http::header::parse_upgrade_header(h, req.data(), len < req.size() ? len : req.size());
+      }
+      sink = static_cast<unsigned char>(r);
+    }
+    auto e = high_resolution_clock::now();
+    auto sec = duration_cast<nanoseconds>(e - b).count() / 1'000'000'000.0;
+    std::cout << std::setw(8) << step << "B pieces  " << std::fixed << std::setprecision(2)
+              << n / sec / 1'000'000.0 << " M/s\n";
+  }
+}
+
+#ifdef WS_WITH_ZLIB
+// a push-style JSON message of about `n` bytes
+static std::string make_json(size_t n)
+{
+  std::string r = "[";
+  for(size_t i = 0; r.size() < n; ++i)
+  {
+    r += "{\"id\":" + std::to_string(100000 + i * 37) + ",\"user\":\"user" + std::to_string(i % 23) +
+         "\",\"online\":true,\"score\":" + std::to_string((i * 7919) % 1000) + "},";
+  }
+  r.back() = ']';
+  return r;
+}
+
+// permessage-deflate on JSON messages, no context takeover so every round is the same work. ratio and GB/s of the
+// uncompressed size
+static void bench_deflate()
+{
+  std::vector<size_t> sizes{256, 4096, 65536};
+  std::cout << "\ndeflate             size     ratio  compress   inflate   (GB/s)\n";
+  // owned contexts are reset after every message, pooled ones are borrowed and returned
+  auto pool = std::make_shared<ws::deflate_pool>();
+  for(bool pooled: {false, true})
+  {
+    for(int level: {1, 6, 9})
+    {
+      for(auto n: sizes)
+      {
+        auto msg = make_json(n);
+        ws::deflate_options o{};
+        o.level = level;
+        o.server_no_context_takeover = true;
+        o.client_no_context_takeover = true;
+        // both sides as server: one deflates and the other inflates without takeover
+        ws::permessage_deflate tx{o, pooled ? pool : nullptr};
+        ws::permessage_deflate rx{o, pooled ? pool : nullptr};
+        std::string resp;
+        tx.accept({}, resp);
+        rx.accept({}, resp);
+        ws::detail::Message out;
+        ws::detail::Message in;
+        double c = throughput(msg.size(), [&] {
+          out.reset();
+          tx.encode(ws::detail::opcode::text, ws::buffer(msg), out);
+        }, size_t(1) << 27);
+        double d = throughput(msg.size(), [&] {
+          in.reset();
+          if(rx.decode(ws::buffer(out.peek(), out.readable_size()), in, msg.size()))
+          {
+            std::abort();
+          }
+        }, size_t(1) << 28);
+        double ratio = static_cast<double>(msg.size()) / static_cast<double>(out.readable_size());
+        std::cout << (pooled ? "pooled" : "owned ") << " level " << level << std::setw(10) << msg.size() << std::fixed
+                  << std::setprecision(2) << std::setw(10) << ratio << std::setw(10) << c << std::setw(10) << d
+                  << '\n';
+      }
+    }
+  }
+}
+
+// a mix of JSON and random binary messages, i.e. already compressed media, with and without the adaptive policy.
+// wire bytes relative to the input and microseconds spent in deflate for the whole batch
+static void bench_policy()
+{
+  std::mt19937 gen{42};
+  std::vector<std::pair<ws::detail::opcode, std::string>> msgs;
+  for(int i = 0; i < 400; ++i)
+  {
+    if(i % 2 == 0)
+    {
+      msgs.emplace_back(ws::detail::opcode::text, make_json(32 + (i * 37) % 4096));
+    }
+    else
+    {
+      std::string r(32 + (i * 53) % 8192, '\0');
+      for(auto& c: r)
+      {
+        c = static_cast<char>(gen());
+      }
+      msgs.emplace_back(ws::detail::opcode::binary, std::move(r));
+    }
+  }
+  std::cout << "\npolicy       wire  deflate(us)  compressed  skipped  discarded\n";
+  for(bool adaptive: {false, true})
+  {
+    ws::deflate_options o{};
+    o.server_no_context_takeover = true;
+    o.policy.adaptive = adaptive;
+    ws::permessage_deflate tx{o};
+    std::string resp;
+    tx.accept({}, resp);
+    ws::detail::Message out;
+    size_t in = 0;
+    size_t wire = 0;
+    for(auto& m: msgs)
+    {
+      out.reset();
+      in += m.second.size();
+      wire += tx.encode(m.first, ws::buffer(m.second), out) ? out.readable_size() : m.second.size();
+    }
+    auto& st = tx.stats();
+    std::cout << (adaptive ? "adaptive" : "always  ") << std::fixed << std::setprecision(2) << std::setw(8)
+              << static_cast<double>(wire) / static_cast<double>(in) << std::setw(13) << st.nanoseconds / 1000
+              << std::setw(12) << st.compressed << std::setw(9)
+              << st.skipped_small + st.skipped_entropy + st.skipped_history << std::setw(11) << st.discarded << '\n';
+  }
+}
+
+// an 8MB snapshot compressed on the calling thread or in chunks on a compress_pool. ms of wall time per message and
+// how long the caller is blocked
+static void bench_parallel()
+{
+  auto msg = std::make_shared<const std::string>(make_json(8 << 20));
+  auto workers = std::make_shared<ws::compress_pool>();
+  std::cout << "\nparallel     " << workers->size() << " workers\n           wall   blocked     ratio   (ms)\n";
+  for(bool parallel: {false, true})
+  {
+    ws::deflate_options o{};
+    o.server_no_context_takeover = true;
+    ws::permessage_deflate e{o};
+    std::string resp;
+    e.accept({}, resp);
+    if(parallel)
+    {
+      e.set_workers(workers);
+    }
+    double wall = 0;
+    double blocked = 0;
+    size_t size = 0;
+    constexpr int kRounds = 5;
+    for(int i = 0; i < kRounds; ++i)
+    {
+      std::mutex mtx;
+      std::condition_variable cv;
+      bool done = false;
+      auto b = high_resolution_clock::now();
+      if(e.is_parallel(msg->size()))
+      {
+        e.encode_async(ws::detail::opcode::text, msg, [&](uint8_t, std::shared_ptr<ws::detail::Message> out) {
+          std::lock_guard<std::mutex> lg{mtx};
+          size = out->readable_size();
+          done = true;
+          cv.notify_one();
+        });
+        blocked += duration_cast<nanoseconds>(high_resolution_clock::now() - b).count() / 1e6;
+        std::unique_lock<std::mutex> lk{mtx};
+        cv.wait(lk, [&] { return done; });
+      }
+      else
+      {
+        ws::detail::Message out;
+        e.encode(ws::detail::opcode::text, ws::buffer(*msg), out);
+        size = out.readable_size();
+        blocked += duration_cast<nanoseconds>(high_resolution_clock::now() - b).count() / 1e6;
+      }
+      wall += duration_cast<nanoseconds>(high_resolution_clock::now() - b).count() / 1e6;
+    }
+    std::cout << (parallel ? "chunked" : "inline ") << std::fixed << std::setprecision(2) << std::setw(10)
+              << wall / kRounds << std::setw(10) << blocked / kRounds << std::setw(10)
+              << static_cast<double>(msg->size()) / static_cast<double>(size) << '\n';
+  }
+}
+
+// one message to 1000 subscribers without context takeover: compressed and framed for each of them, or prepared once
+// and looked up by each. microseconds per broadcast
+static void bench_broadcast()
+{
+  constexpr size_t kSubscribers = 1000;
+  auto pool = std::make_shared<ws::deflate_pool>();
+  ws::deflate_options o{};
+  o.server_no_context_takeover = true;
+  std::vector<std::shared_ptr<ws::permessage_deflate>> exts;
+  std::vector<ws::detail::ExtensionSet> subs(kSubscribers);
+  for(auto& s: subs)
+  {
+    exts.push_back(std::make_shared<ws::permessage_deflate>(o, pool));
+    s.add(exts.back());
+    std::string resp;
+    s.accept("permessage-deflate", resp);
+  }
+  std::cout << "\nbroadcast    size  per-conn  prepared   (us)\n";
+  for(size_t n: {256, 4096, 65536})
+  {
+    auto msg = make_json(n);
+    ws::detail::Message tmp;
+    ws::detail::Message out;
+    auto us = [](std::function<void()> f) {
+      f();
+      int rounds = 5;
+      auto b = high_resolution_clock::now();
+      for(int i = 0; i < rounds; ++i)
+      {
+        f();
+      }
+      return duration_cast<nanoseconds>(high_resolution_clock::now() - b).count() / 1000.0 / rounds;
+    };
+    double each = us([&] {
+      for(auto& s: subs)
+      {
+        uint8_t rsv = 0;
+        out.reset();
+        auto data = s.encode(ws::detail::opcode::text, ws::buffer(msg), tmp, rsv);
+        ws::detail::WsFrame f{};
+        f.set_rsv(rsv);
+        f.set_fin();
+        f.set_code(ws::detail::opcode::text);
+        f.set_payload_size(data.readable_size());
+        out.make_space(14 + data.readable_size());
+        out.write(f.build(out.begin_write()));
+        out.append(data.peek(), data.readable_size());
+      }
+    });
+    std::string key;
+    double once = us([&] {
+      ws::prepared_message m{ws::buffer(msg)};
+      for(auto& s: subs)
+      {
+        s.encoding_key(key);
+        if(m.find(key) == nullptr)
+        {
+          uint8_t rsv = 0;
+          auto data = s.encode(ws::detail::opcode::text, m.payload(), tmp, rsv);
+          m.add(key, data, rsv);
+        }
+      }
+    });
+    std::cout << "        " << std::setw(8) << msg.size() << std::fixed << std::setprecision(1) << std::setw(10) << each
+              << std::setw(10) << once << '\n';
+  }
+}
+#endif
+
+#if defined(WS_WITH_ZLIB) && defined(WS_WITH_ZSTD)
+// messages of a recorded corpus, one per line, or generated JSON. a dictionary is trained on the first half and every
+// codec compresses the second half message by message without context. wire bytes relative to the input and GB/s of
+// the uncompressed size
+static void bench_zstd(const char* corpus)
+{
+  std::vector<std::string> msgs;
+  if(corpus != nullptr)
+  {
+    std::ifstream in{corpus};
+    for(std::string line; std::getline(in, line);)
+    {
+      if(!line.empty())
+      {
+        msgs.push_back(line);
+      }
+    }
+  }
+  else
+  {
+    for(size_t i = 0; i < 4000; ++i)
+    {
+      msgs.push_back(make_json(64 + (i * 131) % 1024));
+    }
+  }
+  if(msgs.size() < 2)
+  {
+    std::cout << "\nzstd: not enough messages\n";
+    return;
+  }
+  std::vector<std::string> train(msgs.begin(), msgs.begin() + msgs.size() / 2);
+  std::vector<std::string> test(msgs.begin() + msgs.size() / 2, msgs.end());
+  std::string samples;
+  std::vector<size_t> sizes;
+  for(auto& m: train)
+  {
+    samples.append(m);
+    sizes.push_back(m.size());
+  }
+  std::string dict(112640, '\0'); // zstd --train default
+  auto cnt = static_cast<unsigned>(sizes.size());
+  auto n = ZDICT_trainFromBuffer(&dict[0], dict.size(), samples.data(), sizes.data(), cnt);
+  std::error_code ec;
+  auto d = ZDICT_isError(n) ? nullptr : ws::zstd_dictionary::create(dict.substr(0, n), ZSTD_CLEVEL_DEFAULT, ec);
+  if(!d)
+  {
+    std::cout << "\nzstd: dictionary training failed\n";
+    return;
+  }
+  size_t total = 0;
+  for(auto& m: test)
+  {
+    total += m.size();
+  }
+
+  ws::deflate_options o{};
+  o.server_no_context_takeover = true;
+  o.client_no_context_takeover = true;
+  o.policy.adaptive = false;
+  std::vector<std::pair<std::string, std::shared_ptr<ws::extension>>> codecs;
+  codecs.emplace_back("deflate", std::make_shared<ws::permessage_deflate>(o));
+  codecs.emplace_back("zstd", std::make_shared<ws::permessage_zstd>());
+  codecs.emplace_back("zstd+dict", std::make_shared<ws::permessage_zstd>(
+                                       std::vector<std::shared_ptr<const ws::zstd_dictionary>>{d}));
+  std::cout << "\nzstd       " << test.size() << " messages, " << total / test.size() << " bytes average, dictionary "
+            << n << " bytes\ncodec          ratio  compress   inflate   (GB/s)\n";
+  for(auto& c: codecs)
+  {
+    auto& e = *c.second;
+    std::string resp;
+    if(e.name() == "x-permessage-zstd")
+    {
+      e.confirm(c.first == "zstd" ? ws::ext_params{} : ws::ext_params{{"dict_id", std::to_string(d->id())}});
+    }
+    else
+    {
+      e.accept({}, resp);
+    }
+    std::vector<ws::detail::Message> out(test.size());
+    std::vector<uint8_t> rsv(test.size());
+    double cs = throughput(total, [&] {
+      for(size_t i = 0; i < test.size(); ++i)
+      {
+        out[i].reset();
+        rsv[i] = e.encode(ws::detail::opcode::text, ws::buffer(test[i]), out[i]);
+      }
+    }, size_t(1) << 26);
+    size_t wire = 0;
+    for(size_t i = 0; i < test.size(); ++i)
+    {
+      wire += rsv[i] ? out[i].readable_size() : test[i].size();
+    }
+    ws::detail::Message tmp;
+    double ds = throughput(total, [&] {
+      for(size_t i = 0; i < test.size(); ++i)
+      {
+        tmp.reset();
+        if(rsv[i] && e.decode(ws::buffer(out[i].peek(), out[i].readable_size()), tmp, 1 << 20))
+        {
+          std::abort();
+        }
+      }
+    }, size_t(1) << 27);
+    std::cout << std::setw(10) << std::left << c.first << std::right << std::fixed << std::setprecision(2)
+              << std::setw(10) << static_cast<double>(wire) / static_cast<double>(total) << std::setw(10) << cs
+              << std::setw(10) << ds << '\n';
+  }
+}
+#endif
+
+int main(int argc, char* argv[])
+{
+  std::string which = argc > 1 ? argv[1] : "all";
+  if(which == "all" || which == "mask")
+  {
+    bench_mask();
+  }
+  if(which == "all" || which == "mask_copy")
+  {
+    bench_mask_copy();
+  }
+  if(which == "all" || which == "encode")
+  {
+    bench_encode();
+  }
+  if(which == "all" || which == "utf8")
+  {
+    bench_utf8();
+  }
+  if(which == "all" || which == "sha1")
+  {
+    bench_sha1();
+  }
+  if(which == "all" || which == "base64")
+  {
+    bench_base64();
+  }
+  if(which == "all" || which == "header")
+  {
+    bench_header();
+  }
+#ifdef WS_WITH_ZLIB
+  if(which == "all" || which == "deflate")
+  {
+    bench_deflate();
+  }
+  if(which == "all" || which == "policy")
+  {
+    bench_policy();
+  }
+  if(which == "all" || which == "parallel")
+  {
+    bench_parallel();
+  }
+  if(which == "all" || which == "broadcast")
+  {
+    bench_broadcast();
+  }
+#endif
+#if defined(WS_WITH_ZLIB) && defined(WS_WITH_ZSTD)
+  // bench zstd [corpus]
+  if(which == "all" || which == "zstd")
+  {
+    bench_zstd(which == "zstd" && argc > 2 ? argv[2] : nullptr);
+  }
+#endif
+}
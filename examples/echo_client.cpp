@@ -9,15 +9,13 @@
 #include "websocket.h"
 #include <iostream>
 
-using sock = ws::stream<asio::ip::tcp::socket>;
+using sock = ws::stream<asio::ip::tcp::socket, ws::role::client>;
 
 class Client
 {
 public:
   Client(asio::io_context& ioc, const asio::ip::tcp::endpoint& ep, int num) : sock_{ioc}, ep_{ep}, limit_{num}
   {
-    sock_.is_mask_set();
-    sock_.set_mask(true);
     sock_.set_fragment_size(4096);
     sock_.set_max_message_size(1 << 20);
     sock_.max_message_size();
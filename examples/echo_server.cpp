@@ -10,7 +10,7 @@
 #include <iostream>
 #include <set>
 
-using sock_t = ws::stream<asio::ip::tcp::socket>;
+using sock_t = ws::stream<asio::ip::tcp::socket, ws::role::server>;
 
 class EchoHandler : public std::enable_shared_from_this<EchoHandler>
 {
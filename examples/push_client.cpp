@@ -9,7 +9,7 @@
 #include "websocket.h"
 #include <iostream>
 
-using sock = ws::stream<asio::ip::tcp::socket>;
+using sock = ws::stream<asio::ip::tcp::socket, ws::role::client>;
 
 class Client
 {
@@ -18,12 +18,13 @@ public:
       : ioc_{ioc}, timer_{ioc}, sock_{ioc}, ep_{ep}, limit_{num}
   {
     ss_ = std::to_string(getpid());
-    sock_.is_mask_set();
-    sock_.set_mask(true);
     sock_.set_fragment_size(4096);
     sock_.set_max_message_size(1 << 20);
     sock_.max_message_size();
     sock_.set_ping_msg("ping", std::chrono::seconds(5));
+#ifdef WS_WITH_ZLIB
+    sock_.add_extension(std::make_shared<ws::permessage_deflate>());
+#endif
     sock_.next_layer().async_connect(ep_, [this](const std::error_code& ec) {
       if(ec)
       {
@@ -7,10 +7,12 @@
 
 #include "common.h"
 #include "websocket.h"
+#include <atomic>
 #include <iostream>
+#include <map>
 #include <set>
 
-using sock_t = ws::stream<asio::ip::tcp::socket>;
+using sock_t = ws::stream<asio::ip::tcp::socket, ws::role::server>;
 
 class PushHandler;
 using PushHandlerPtr = std::shared_ptr<PushHandler>;
@@ -39,6 +41,10 @@ public:
 
   void push(const ws::Buffer& buf);
 
+#ifdef WS_WITH_ZLIB
+  std::shared_ptr<ws::deflate_pool> deflate_pool(asio::io_context& ioc);
+#endif
+
 private:
   bool is_running_{false};
   std::mutex mtx_{};
@@ -46,6 +52,11 @@ private:
   std::unique_ptr<asio::ip::tcp::acceptor> acceptor_;
   std::unique_ptr<asio::signal_set> signals_;
   std::list<PushHandlerWPtr> clients_;
+#ifdef WS_WITH_ZLIB
+  // 256MB for connections keeping their compression context, one pool of borrowed contexts per io_context
+  std::shared_ptr<ws::deflate_budget> budget_{std::make_shared<ws::deflate_budget>(256 << 20)};
+  std::map<asio::io_context*, std::shared_ptr<ws::deflate_pool>> deflate_pools_;
+#endif
 };
 
 class PushHandler : public std::enable_shared_from_this<PushHandler>
@@ -68,6 +79,12 @@ public:
   void run()
   {
     sock_.set_ping_msg("are you ok?", std::chrono::seconds(5));
+#ifdef WS_WITH_ZLIB
+    // without context takeover every client shares the compressed broadcast
+    ws::deflate_options opt{};
+    opt.server_no_context_takeover = true;
+    sock_.add_extension(std::make_shared<ws::permessage_deflate>(opt, server_->deflate_pool(sock_.context())));
+#endif
     auto self = shared_from_this();
     sock_.accept([self, this](http::header& h, const std::error_code& ec) {
       if(ec)
@@ -83,21 +100,25 @@ public:
 
   bool alive() { return alive_; }
 
-  void send(const ws::Buffer& buf)
+  // called from the io_context of the connection which read the message, the stream and its deflate_pool are only
+  // used from their own
+  void send(std::shared_ptr<const ws::prepared_message> msg)
   {
     auto self = shared_from_this();
-    sock_.write_text(buf, [self, this](const std::error_code& ec, size_t) {
-      if(ec)
-      {
-        std::cerr << "send error: " << ec.message() << '\n';
-        alive_ = false;
-        sock_.force_close();
-      }
+    asio::post(sock_.context(), [self, this, msg] {
+      sock_.write_prepared(msg, [self, this](const std::error_code& ec, size_t) {
+        if(ec)
+        {
+          std::cerr << "send error: " << ec.message() << '\n';
+          alive_ = false;
+          sock_.force_close();
+        }
+      });
     });
   }
 
 private:
-  bool alive_{true};
+  std::atomic<bool> alive_{true};
   sock_t sock_;
   WsServer* server_;
 
@@ -176,8 +197,9 @@ void WsServer::accept()
 void WsServer::push(const ws::Buffer& buf)
 {
   std::lock_guard<std::mutex> lg{mtx_};
-  // `buf` will be invalid after `read`, since it's a view of internal read buffer
-  std::string data{buf.peek(), buf.readable_size()};
+  // `buf` will be invalid after `read`, since it's a view of internal read buffer. the message is framed, and
+  // compressed for clients sharing a configuration, once for all of them
+  auto msg = std::make_shared<ws::prepared_message>(buf);
   for(auto iter = clients_.begin(); iter != clients_.end();)
   {
     auto c = iter->lock();
@@ -185,7 +207,7 @@ void WsServer::push(const ws::Buffer& buf)
     {
       if(c->alive())
       {
-        c->send(ws::buffer(data));
+        c->send(msg);
       }
       ++iter;
     }
@@ -196,6 +218,19 @@ void WsServer::push(const ws::Buffer& buf)
   }
 }
 
+#ifdef WS_WITH_ZLIB
+std::shared_ptr<ws::deflate_pool> WsServer::deflate_pool(asio::io_context& ioc)
+{
+  // only called from the acceptor's io_context
+  auto& p = deflate_pools_[&ioc];
+  if(!p)
+  {
+    p = std::make_shared<ws::deflate_pool>(8, budget_);
+  }
+  return p;
+}
+#endif
+
 void WsServer::insert(PushHandlerPtr conn)
 {
   std::lock_guard<std::mutex> lg{mtx_};
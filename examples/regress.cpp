@@ -0,0 +1,374 @@
+/*********************************************************
+          File Name: regress.cpp
+          Author: Abby Cin
+          Mail: abbytsing@gmail.com
+          Created Time: Mon 19 Oct 2026 10:02:37 AM CST
+**********************************************************/
+
+#include "asio.hpp"
+#include "websocket.h"
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// scenarios which once broke, each one a server stream and a client over loopback. exits with 1 when any of them
+// fails
+
+using sock_t = ws::stream<asio::ip::tcp::socket, ws::role::server>;
+using client_t = ws::stream<asio::ip::tcp::socket, ws::role::client>;
+
+static int g_failed = 0;
+
+static void check(bool ok, const char* what)
+{
+  if(!ok)
+  {
+    std::cerr << "failed: " << what << '\n';
+    g_failed += 1;
+  }
+}
+
+struct Frame
+{
+  uint8_t code;
+  std::string payload;
+};
+
+// a client frame masked with a zero key, so the payload goes as is
+static std::string client_frame(uint8_t code, const std::string& payload, uint8_t rsv = 0)
+{
+  std::string f;
+  f.push_back(static_cast<char>(0x80 | rsv | code));
+  if(payload.size() < 126)
+  {
+    f.push_back(static_cast<char>(0x80 | payload.size()));
+  }
+  else
+  {
+    f.push_back(static_cast<char>(0x80 | 126));
+    f.push_back(static_cast<char>(payload.size() >> 8));
+    f.push_back(static_cast<char>(payload.size() & 0xff));
+  }
+  f.append(4, '\0');
+  f.append(payload);
+  return f;
+}
+
+// the whole server frames at the front of `in`
+static std::vector<Frame> parse_frames(const std::string& in)
+{
+  std::vector<Frame> res;
+  size_t pos = 0;
+  while(in.size() - pos >= 2)
+  {
+    size_t len = static_cast<uint8_t>(in[pos + 1]) & 0x7f;
+    size_t hdr = 2;
+    if(len == 126)
+    {
+      if(in.size() - pos < 4)
+      {
+        break;
+      }
+      len = static_cast<size_t>(static_cast<uint8_t>(in[pos + 2])) << 8 | static_cast<uint8_t>(in[pos + 3]);
+      hdr = 4;
+    }
+    else if(len == 127)
+    {
+      if(in.size() - pos < 10)
+      {
+        break;
+      }
+      len = 0;
+      for(size_t i = 0; i < 8; ++i)
+      {
+        len = len << 8 | static_cast<uint8_t>(in[pos + 2 + i]);
+      }
+      hdr = 10;
+    }
+    if(in.size() - pos - hdr < len)
+    {
+      break;
+    }
+    res.push_back({static_cast<uint8_t>(in[pos] & 0x0f), in.substr(pos + hdr, len)});
+    pos += hdr + len;
+  }
+  return res;
+}
+
+// runs the io_context and reads from `peer` until `done` is satisfied with what arrived, false on a read error.
+// no read is left pending on return
+template<typename F>
+static bool receive(asio::io_context& ioc, asio::ip::tcp::socket& peer, std::string& in, F&& done)
+{
+  char buf[4096];
+  bool failed = false;
+  while(!done(in))
+  {
+    bool reading = true;
+    peer.async_read_some(asio::buffer(buf, sizeof(buf)), [&](const std::error_code& ec, size_t n) {
+      reading = false;
+      failed = static_cast<bool>(ec);
+      in.append(buf, n);
+    });
+    while(reading)
+    {
+      ioc.run_one();
+    }
+    if(failed)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// `srv` accepts the raw client `peer`, whose upgrade request has the field lines `fields` too. the 101 response is
+// consumed
+static bool open(asio::io_context& ioc, asio::ip::tcp::acceptor& acceptor, asio::ip::tcp::socket& peer, sock_t& srv,
+                 const std::string& fields = {})
+{
+  peer.connect(acceptor.local_endpoint());
+  acceptor.accept(srv.next_layer());
+  std::string req = "GET / HTTP/1.1\r\n"
+                    "Host: 127.0.0.1\r\n"
+                    "Upgrade: websocket\r\n"
+                    "Connection: Upgrade\r\n"
+                    "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                    "Sec-WebSocket-Version: 13\r\n" +
+                    fields + "\r\n";
+  std::error_code ec;
+  asio::write(peer, asio::buffer(req.data(), req.size()), ec);
+  bool done = false;
+  bool ok = false;
+  srv.accept([&done, &ok](http::header&, const std::error_code& e) {
+    done = true;
+    ok = !e;
+  });
+  while(!done)
+  {
+    ioc.run_one();
+  }
+  std::string in;
+  return !ec && ok && receive(ioc, peer, in, [](const std::string& s) { return s.find("\r\n\r\n") != s.npos; });
+}
+
+// the stream is closed and what it has pending is run
+static void finish(asio::io_context& ioc, sock_t& srv)
+{
+  srv.force_close();
+  ioc.run();
+  ioc.restart();
+}
+
+// a ping answered from a send callback, while the message just written was the last one queued. the pong used to
+// be inserted past the end of the queue
+static void pong_from_send_callback(asio::io_context& ioc, asio::ip::tcp::acceptor& acceptor)
+{
+  asio::ip::tcp::socket peer{ioc};
+  sock_t srv{ioc};
+  if(!open(ioc, acceptor, peer, srv))
+  {
+    check(false, "pong_from_send_callback: handshake");
+    return;
+  }
+  // in one write, so the ping waits in the server's read buffer while it replies
+  auto req = client_frame(0x1, "hello") + client_frame(0x9, "are you there");
+  std::error_code ec;
+  asio::write(peer, asio::buffer(req.data(), req.size()), ec);
+  bool replied = false;
+  srv.read([&](const std::error_code& e, const ws::Buffer&) {
+    check(!e, "pong_from_send_callback: read");
+    srv.write_text(ws::buffer("reply"), [&](const std::error_code& e2, size_t) {
+      replied = !e2;
+      srv.read([](const std::error_code&, const ws::Buffer&) {});
+    });
+  });
+  std::string in;
+  receive(ioc, peer, in, [](const std::string& s) { return parse_frames(s).size() >= 2; });
+  auto f = parse_frames(in);
+  check(replied && f.size() == 2, "pong_from_send_callback: two frames");
+  check(f.size() == 2 && f[0].code == 0x1 && f[0].payload == "reply", "pong_from_send_callback: reply first");
+  check(f.size() == 2 && f[1].code == 0xa && f[1].payload == "are you there", "pong_from_send_callback: pong");
+  finish(ioc, srv);
+}
+
+#ifdef WS_WITH_ZLIB
+// a compressed message echoed twice from the read callback. encoding the first echo used to hand the buffer the
+// message was decoded into to the second one as scratch, overwriting what the callback was still viewing
+static void echo_compressed_twice(asio::io_context& ioc, asio::ip::tcp::acceptor& acceptor)
+{
+  client_t cli{ioc};
+  sock_t srv{ioc};
+  ws::deflate_options opt{};
+  opt.policy.adaptive = false;
+  cli.add_extension(std::make_shared<ws::permessage_deflate>(opt));
+  srv.add_extension(std::make_shared<ws::permessage_deflate>(opt));
+  cli.next_layer().connect(acceptor.local_endpoint());
+  acceptor.accept(srv.next_layer());
+  int opened = 0;
+  bool ok = true;
+  srv.accept([&](http::header&, const std::error_code& e) {
+    opened += 1;
+    ok = ok && !e;
+  });
+  cli.handshake("ws://127.0.0.1", "/", [&](const std::error_code& e) {
+    opened += 1;
+    ok = ok && !e;
+  });
+  while(opened < 2)
+  {
+    ioc.run_one();
+  }
+  if(!ok)
+  {
+    check(false, "echo_compressed_twice: handshake");
+    finish(ioc, srv);
+    return;
+  }
+  std::string msg;
+  for(int i = 0; msg.size() < 4096; ++i)
+  {
+    msg += "{\"id\":" + std::to_string(i) + ",\"name\":\"user\",\"online\":true},";
+  }
+  srv.read([&](const std::error_code& e, const ws::Buffer& b) {
+    check(!e, "echo_compressed_twice: server read");
+    srv.write_text(b, [](const std::error_code&, size_t) {});
+    srv.write_text(b, [](const std::error_code&, size_t) {});
+    check(std::string(b.peek(), b.readable_size()) == msg, "echo_compressed_twice: read view after the echoes");
+  });
+  cli.write_text(ws::buffer(msg), [](const std::error_code&, size_t) {});
+  std::vector<std::string> echoes;
+  bool failed = false;
+  std::function<void()> next = [&] {
+    cli.read([&](const std::error_code& e, const ws::Buffer& b) {
+      if(e)
+      {
+        failed = true;
+        return;
+      }
+      echoes.emplace_back(b.peek(), b.readable_size());
+      if(echoes.size() < 2)
+      {
+        next();
+      }
+    });
+  };
+  next();
+  while(!failed && echoes.size() < 2)
+  {
+    ioc.run_one();
+  }
+  check(!failed, "echo_compressed_twice: client read");
+  check(echoes.size() > 0 && echoes[0] == msg, "echo_compressed_twice: first echo");
+  check(echoes.size() > 1 && echoes[1] == msg, "echo_compressed_twice: second echo");
+  cli.force_close();
+  finish(ioc, srv);
+}
+
+// raw deflate of each message, as a peer keeping its context does it with zlib
+class Deflater
+{
+public:
+  explicit Deflater(int bits)
+  {
+    ok_ = ::deflateInit2(&z_, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -bits, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+  }
+
+  Deflater(const Deflater&) = delete;
+
+  Deflater& operator=(const Deflater&) = delete;
+
+  ~Deflater() { ::deflateEnd(&z_); }
+
+  std::string message(const std::string& in)
+  {
+    if(!ok_)
+    {
+      return {};
+    }
+    std::string out(::deflateBound(&z_, static_cast<uLong>(in.size())) + 16, '\0');
+    z_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    z_.avail_in = static_cast<uInt>(in.size());
+    z_.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    z_.avail_out = static_cast<uInt>(out.size());
+    ::deflate(&z_, Z_SYNC_FLUSH);
+    out.resize(out.size() - z_.avail_out);
+    // a message drops the empty block which ends the flush
+    out.resize(out.size() < 4 ? 0 : out.size() - 4);
+    return out;
+  }
+
+private:
+  z_stream z_{};
+  bool ok_{false};
+};
+
+// a client limited to an 8 bits window. zlib can't deflate with less than 9 bits, so a peer may match up to 512 bytes
+// back, into the previous message too, which an inflater of 8 bits used to reject
+static void inflate_window_8(asio::io_context& ioc, asio::ip::tcp::acceptor& acceptor)
+{
+  asio::ip::tcp::socket peer{ioc};
+  sock_t srv{ioc};
+  srv.add_extension(std::make_shared<ws::permessage_deflate>());
+  if(!open(ioc, acceptor, peer, srv, "Sec-WebSocket-Extensions: permessage-deflate; client_max_window_bits=8\r\n"))
+  {
+    check(false, "inflate_window_8: handshake");
+    finish(ioc, srv);
+    return;
+  }
+  // 400 bytes sent twice, the second time matched 400 bytes back. zlib keeps its matches 262 bytes short of its
+  // window, so they are deflated with 10 bits, the data has no match further back
+  std::string msg;
+  uint32_t x = 1;
+  while(msg.size() < 400)
+  {
+    x = x * 1103515245 + 12345;
+    msg.push_back(static_cast<char>('a' + (x >> 16) % 26));
+  }
+  Deflater d{10};
+  auto first = d.message(msg);
+  auto second = d.message(msg);
+  check(!first.empty() && second.size() < 100, "inflate_window_8: deflate");
+  auto req = client_frame(0x1, first, 0x40) + client_frame(0x1, second, 0x40);
+  std::error_code ec;
+  asio::write(peer, asio::buffer(req.data(), req.size()), ec);
+  std::vector<std::string> got;
+  bool failed = false;
+  std::function<void()> next = [&] {
+    srv.read([&](const std::error_code& e, const ws::Buffer& b) {
+      if(e)
+      {
+        failed = true;
+        return;
+      }
+      got.emplace_back(b.peek(), b.readable_size());
+      if(got.size() < 2)
+      {
+        next();
+      }
+    });
+  };
+  next();
+  while(!failed && got.size() < 2)
+  {
+    ioc.run_one();
+  }
+  check(!failed, "inflate_window_8: read");
+  check(got.size() == 2 && got[0] == msg && got[1] == msg, "inflate_window_8: messages");
+  finish(ioc, srv);
+}
+#endif
+
+int main()
+{
+  asio::io_context ioc;
+  asio::ip::tcp::acceptor acceptor{ioc, asio::ip::tcp::endpoint{asio::ip::address_v4::loopback(), 0}};
+  pong_from_send_callback(ioc, acceptor);
+#ifdef WS_WITH_ZLIB
+  echo_compressed_twice(ioc, acceptor);
+  inflate_window_8(ioc, acceptor);
+#endif
+  std::cout << (g_failed == 0 ? "all passed" : "some failed") << '\n';
+  return g_failed == 0 ? 0 : 1;
+}
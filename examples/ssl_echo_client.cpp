@@ -10,15 +10,13 @@
 #include "websocket.h"
 #include <iostream>
 
-using sock = ws::stream<asio::ssl::stream<asio::ip::tcp::socket>>;
+using sock = ws::stream<asio::ssl::stream<asio::ip::tcp::socket>, ws::role::client>;
 
 class Client
 {
 public:
   Client(asio::io_context& ioc, int num) : ctx_{asio::ssl::context::tlsv12_client}, sock_{ioc, ctx_}, limit_{num}
   {
-    sock_.is_mask_set();
-    sock_.set_mask(false);
     sock_.set_fragment_size(4096);
     sock_.set_max_message_size(1 << 20);
   }
@@ -11,7 +11,7 @@
 #include <iostream>
 #include <set>
 
-using sock_t = ws::stream<asio::ssl::stream<asio::ip::tcp::socket>>;
+using sock_t = ws::stream<asio::ssl::stream<asio::ip::tcp::socket>, ws::role::server>;
 
 class EchoHanlder : public std::enable_shared_from_this<EchoHanlder>
 {
@@ -10,12 +10,47 @@
 
 namespace ws
 {
+  // a role fixes masking at compile time: clients mask every outbound frame and require unmasked inbound frames,
+  // servers are the reverse. `any` leaves it to set_mask and doesn't check inbound frames
+  namespace role
+  {
+    struct any
+    {
+      constexpr static bool is_fixed = false;
+      constexpr static bool mask_outbound = false;
+      constexpr static bool mask_inbound = false;
+    };
+
+    struct client
+    {
+      constexpr static bool is_fixed = true;
+      constexpr static bool mask_outbound = true;
+      constexpr static bool mask_inbound = false;
+    };
+
+    struct server
+    {
+      constexpr static bool is_fixed = true;
+      constexpr static bool mask_outbound = false;
+      constexpr static bool mask_inbound = true;
+    };
+  }
+
   using AcceptCallback = std::function<void(http::header&, const std::error_code&)>;
   using HandshakeCallback = std::function<void(const std::error_code&)>;
   using RecvCallback = std::function<void(const std::error_code&, const Buffer&)>;
   using SendCallback = std::function<void(const std::error_code&, size_t)>;
 
-  template<typename NextLayer>
+  // where a piece passed to read_some sits in its message
+  struct message_chunk
+  {
+    bool first;          // the message starts with it
+    bool last;           // the message ends with it
+    detail::opcode code; // text or binary, of the whole message
+  };
+  using ChunkCallback = std::function<void(const std::error_code&, const Buffer&, const message_chunk&)>;
+
+  template<typename NextLayer, typename Role = role::any>
   class stream
   {
   public:
@@ -52,8 +87,28 @@ namespace ws
 
     bool is_mask_set();
 
+    void set_validate_utf8(bool on);
+
+    bool is_validate_utf8_set();
+
+    // off by default. when on, a stream which doesn't mask writes the payload of write_text, write_binary,
+    // write_chunk and end_message in place after the frame headers instead of copying it, the buffer must then stay
+    // valid and unchanged until `cb` is called, so it can't be a temporary or a view from read
+    void set_write_in_place(bool on);
+
+    bool is_write_in_place_set();
+
     std::error_code last_error();
 
+    // offered by a client or accepted from a client offer by a server, call it before handshake/accept
+    void add_extension(std::shared_ptr<extension> ext);
+
+    // a client offers them in this order, a server picks the first one it supports from the client's list
+    void set_subprotocols(std::vector<std::string> protocols);
+
+    // agreed on in the handshake, empty when there's none
+    const std::string& subprotocol();
+
     NextLayer& next_layer();
 
     typename NextLayer::lowest_layer_type& lowest_layer();
@@ -68,12 +123,34 @@ namespace ws
 
     void force_close();
 
+    // the message passed to `cb` is a view of the stream's read buffers, valid until the next read
     void read(RecvCallback cb);
 
+    // a piece of a message as soon as it's unmasked, without reassembly, so memory use doesn't depend on message
+    // size and max_message_size doesn't apply. pieces are frames or parts of them and may be empty. a compressed
+    // message is still decoded as a whole and comes in one piece. switch between read and read_some only between
+    // messages
+    void read_some(ChunkCallback cb);
+
+    // writes issued before earlier ones complete are queued and go out in order, each `cb` is called once its
+    // message is written. `buf` is copied unless set_write_in_place is on
     void write_text(const Buffer& buf, SendCallback cb);
 
     void write_binary(const Buffer& buf, SendCallback cb);
 
+    // `msg` is kept alive until `cb` is called, the size passed to `cb` is its payload size
+    void write_prepared(std::shared_ptr<const prepared_message> msg, SendCallback cb);
+
+    // a message of unknown size, one frame per chunk: begin_message, write_chunk after the previous chunk completed,
+    // then end_message with the last chunk, which may be empty. other messages wait until it ends, control frames
+    // don't. it isn't compressed and max_message_size doesn't apply. one at a time, begin_message fails with
+    // ws_error::message_open while another message is open
+    std::error_code begin_message(bool binary = false);
+
+    void write_chunk(const Buffer& buf, SendCallback cb);
+
+    void end_message(const Buffer& buf, SendCallback cb);
+
     asio::io_context& context();
 
   private:
@@ -56,22 +56,22 @@ namespace ws
     };
   }
 
-  template<typename NextLayer>
-  class stream<NextLayer>::impl : public std::enable_shared_from_this<stream<NextLayer>::impl>
+  template<typename NextLayer, typename Role>
+  class stream<NextLayer, Role>::impl : public std::enable_shared_from_this<stream<NextLayer, Role>::impl>
   {
   public:
     constexpr static size_t kFragmentSize = 4096;
     constexpr static size_t kMaxMsgSize = kFragmentSize * 4;
     constexpr static size_t kMinFrameSize = 2;
     constexpr static size_t kMaxFrameSize = 14;
-    using std::enable_shared_from_this<stream<NextLayer>::impl>::shared_from_this;
+    using std::enable_shared_from_this<stream<NextLayer, Role>::impl>::shared_from_this;
 
     template<typename... Args>
     explicit impl(Args&&... args)
         : msg_type_{NONE}, status_{CLOSED}, fragment_size_{kFragmentSize}, max_msg_size_{kMaxMsgSize},
           socket_{std::forward<Args>(args)...}, wrapper_{socket_}, timer_{socket_.get_executor()},
           last_error_{}, ping_msg_{}, ping_interval_{},
-          last_heartbeat_{}, frame_{}, header_{}, rd_buf_{kMaxMsgSize}, ctrl_{}, payload_{kMaxFrameSize}, wr_buf_{}
+          last_heartbeat_{}, frame_{}, header_{}, rd_buf_{kMaxMsgSize}, payload_{kMaxFrameSize}, wr_buf_{}
     {
     }
 
@@ -111,12 +111,37 @@ namespace ws
 
     bool is_text() { return msg_type_ == TEXT; }
 
+    // no effect when Role fixes masking
     void set_mask(bool off) { mask_ = off; }
 
-    bool is_mask_set() { return mask_; }
+    bool is_mask_set()
+    {
+      if constexpr(Role::is_fixed)
+      {
+        return Role::mask_outbound;
+      }
+      else
+      {
+        return mask_;
+      }
+    }
+
+    void set_validate_utf8(bool on) { validate_utf8_ = on; }
+
+    bool is_validate_utf8_set() { return validate_utf8_; }
+
+    void set_write_in_place(bool on) { write_in_place_ = on; }
+
+    bool is_write_in_place_set() { return write_in_place_; }
 
     std::error_code last_error() { return last_error_; }
 
+    void add_extension(std::shared_ptr<extension> ext) { exts_.add(std::move(ext)); }
+
+    void set_subprotocols(std::vector<std::string> protocols) { protocols_ = std::move(protocols); }
+
+    const std::string& subprotocol() { return protocol_; }
+
     bool is_open() { return status_ == OPENED; }
 
     NextLayer& next_layer() { return socket_; }
@@ -132,6 +157,7 @@ namespace ws
       {
         start_timer();
         header_ = http::header::build_upgrade_header(host, target);
+        this->offer_extensions();
         auto tmp = header_.build();
         wr_buf_.append(tmp.data(), tmp.size());
         auto buf = buffer(wr_buf_.peek(), wr_buf_.readable_size());
@@ -144,6 +170,7 @@ namespace ws
           }
           rd_buf_.reset();
           wr_buf_.reset();
+          header_.reset_parser();
           this->handshake_impl(cb);
         });
       }
@@ -159,7 +186,8 @@ namespace ws
       {
         start_timer();
         rd_buf_.reset();
-        this->accept_impl(cb);
+        header_.reset_parser();
+        this->accept_impl(std::move(cb));
       }
     }
 
@@ -167,6 +195,7 @@ namespace ws
     {
       // assume data contains complete upgrade header
       rd_buf_.append(data.peek(), data.readable_size());
+      header_.reset_parser();
       auto r = http::header::parse_upgrade_header(header_, rd_buf_.peek(), rd_buf_.readable_size());
       if(http::header_error::ok != r)
       {
@@ -174,9 +203,7 @@ namespace ws
         return;
       }
 
-      auto tmp = http::header::build_accept_header(header_);
-
-      wr_buf_.append(tmp.data(), tmp.size());
+      this->write_accept_header();
       rd_buf_.read(header_.size());
       auto buf = buffer(wr_buf_.peek(), wr_buf_.readable_size());
       auto self = shared_from_this();
@@ -216,6 +243,18 @@ namespace ws
       }
     }
 
+    void read_some(ChunkCallback cb)
+    {
+      if(status_ != CLOSED)
+      {
+        this->read_some_impl(cb);
+      }
+      else
+      {
+        cb(make_error_code(ws_error::already_closed), {}, {});
+      }
+    }
+
     void write_text(const Buffer& buf, SendCallback cb)
     {
       if(status_ == OPENED)
@@ -240,6 +279,68 @@ namespace ws
       }
     }
 
+    void write_prepared(std::shared_ptr<const prepared_message> msg, SendCallback cb)
+    {
+      if(!this->writable(cb))
+      {
+        return;
+      }
+      auto payload = msg->payload();
+      if(payload.readable_size() > max_msg_size_)
+      {
+        cb(make_error_code(ws_error::payload_too_big), 0);
+        return;
+      }
+      if(encoding_ || streaming_)
+      {
+        deferred_.emplace_back([this, msg, cb] { this->write_prepared(msg, cb); });
+        return;
+      }
+      auto e = this->prepared_encoding(*msg);
+      if(e == nullptr)
+      {
+        // an extension keeps state across messages, the message is encoded for this stream alone
+        this->prepare_write(payload, msg->code(), cb, msg);
+      }
+      else if(auto o = this->push(payload.readable_size(), cb))
+      {
+        if(this->is_mask_set())
+        {
+          build_write_buffer(o->frames, true, msg->code(), e->payload().readable_size(), e->payload(), e->rsv);
+        }
+        else
+        {
+          // the shared bytes are written as is, `msg` owns them until the write completes
+          o->iov.emplace_back(e->frame.data(), e->frame.size());
+          o->hold = std::move(msg);
+        }
+        this->flush();
+      }
+    }
+
+    std::error_code begin_message(bool binary)
+    {
+      if(status_ != OPENED)
+      {
+        return make_error_code(ws_error::already_closed);
+      }
+      if(last_error_)
+      {
+        return last_error_;
+      }
+      if(message_open_)
+      {
+        return make_error_code(ws_error::message_open);
+      }
+      message_open_ = true;
+      this->start_message(binary);
+      return {};
+    }
+
+    void write_chunk(const Buffer& buf, SendCallback cb) { this->write_chunk(buf, false, cb); }
+
+    void end_message(const Buffer& buf, SendCallback cb) { this->write_chunk(buf, true, cb); }
+
     asio::io_context& context() { return wrapper_.context(); }
 
     void force_close()
@@ -251,6 +352,7 @@ namespace ws
         timer_.cancel(ec);
         wrapper_.cancel(ec);
         wrapper_.close(ec);
+        this->drop_deferred();
       }
     }
 
@@ -270,8 +372,31 @@ namespace ws
       CLOSED = 3
     };
 
+    // a message or control frame waiting to be written
+    struct Outbound
+    {
+      detail::Message frames;              // whole frames, or only their headers when `iov` isn't empty
+      std::vector<asio::const_buffer> iov; // headers gathered with payload written in place
+      std::shared_ptr<const void> hold;    // owns that payload when the caller doesn't
+      size_t bytes;                        // passed to `cb`
+      SendCallback cb;
+      bool control;
+      bool close;
+    };
+
+    constexpr static size_t kMaxSpare = 4;
+
     bool mask_{false};
+    bool validate_utf8_{false};
+    bool write_in_place_{false}; // unmasked payloads are gathered from the caller's buffer instead of copied
+    uint8_t msg_rsv_{0}; // rsv bits of the first frame of the inbound message
+    nm::UTF8::Stream utf8_;
     bool sending_{false};
+    bool encoding_{false};  // an extension is encoding a message on another thread
+    bool message_open_{false}; // begin_message was called and end_message not yet
+    bool streaming_{false};    // the frames of that message are being queued, other messages wait in deferred_
+    detail::opcode chunk_code_{detail::opcode::text}; // of the next frame of that message
+    std::list<std::function<void()>> deferred_;
     MsgType msg_type_;
     ConnStatus status_;
     size_t fragment_size_;
@@ -285,17 +410,86 @@ namespace ws
     std::chrono::system_clock::time_point last_heartbeat_;
     http::header header_;
     detail::WsFrame frame_;
+    detail::FrameIndex index_;
+    size_t index_base_{0};
+    uint64_t chunk_left_{0};   // payload of frame_ read_some hasn't handed out yet
+    uint64_t chunk_offset_{0}; // and what it has
+    bool chunk_first_{false};  // the next piece starts a message
     detail::Message rd_buf_;
-    detail::Message ctrl_;
     detail::Message payload_;
     detail::Message wr_buf_;
+    std::deque<Outbound> queue_;
+    size_t in_flight_{0};                 // entries at the front of queue_ being written
+    std::vector<asio::const_buffer> iov_; // and where they are
+    std::vector<detail::Message> spare_;  // frame buffers of written entries, for those to come
+    detail::ExtensionSet exts_;
+    detail::Message ext_buf_; // decoded message, the read callback's view of it outlives writes
+    detail::Message ext_out_; // encoded message
+    std::vector<std::string> protocols_;
+    std::string protocol_;
+    std::string hs_protocols_;
+    std::string hs_extra_;
+    std::string ext_key_;
+
+    // 0 when the payload of frame_ is not masked, xor with 0 is a no-op anyway
+    uint32_t inbound_mask_key()
+    {
+      if constexpr(Role::is_fixed)
+      {
+        return Role::mask_inbound ? frame_.mask_key() : 0u;
+      }
+      else
+      {
+        return frame_.is_mask_set() ? frame_.mask_key() : 0u;
+      }
+    }
+
+    // text is validated frame by frame as it arrives, a message in a single frame in the same pass as unmasking.
+    // `data` starts `offset` bytes into the payload of frame_, `end` is whether the payload ends with it
+    bool unmask_payload(char* data, size_t n, size_t offset = 0, bool end = true)
+    {
+      auto key = detail::rotate_mask_key(this->inbound_mask_key(), offset);
+      // a transformed message is checked once decoded
+      bool check = validate_utf8_ && !frame_.is_control() && msg_type_ == TEXT && msg_rsv_ == 0;
+      if(check && frame_.is_text() && frame_.is_fin() && offset == 0 && end)
+      {
+        return detail::unmask_utf8(data, n, key);
+      }
+      if(key != 0)
+      {
+        detail::mask(data, n, key);
+      }
+      if(check)
+      {
+        // a code point split between fragments is carried in utf8_
+        return utf8_.feed(data, n) && (!(end && frame_.is_fin()) || utf8_.finish());
+      }
+      return true;
+    }
 
-    void mask(char* data, size_t n, detail::WsFrame& f)
+    // run a message through the extensions which claimed the rsv bits of its first frame, `b` is replaced with the
+    // result
+    std::error_code decode_message(Buffer& b)
     {
-      if(f.is_mask_set())
+      auto ec = exts_.decode(msg_rsv_, b, ext_buf_, max_message_size(), b);
+      if(ec)
+      {
+        payload_.reset();
+        return ec;
+      }
+      if(validate_utf8_ && msg_type_ == TEXT && !nm::UTF8::validate(b.peek(), b.readable_size()))
       {
-        detail::mask(data, n, f.mask_key());
+        return this->bad_payload();
       }
+      return {};
+    }
+
+    std::error_code bad_payload()
+    {
+      payload_.reset();
+      utf8_.reset();
+      this->close(close_code::bad_payload, "invalid utf-8");
+      return make_error_code(ws_error::bad_payload);
     }
 
     void ping(const Buffer& payload = {}) { this->write_ping_pong(payload, detail::opcode::ping); }
@@ -351,9 +545,11 @@ namespace ws
 
     void set_msg_type()
     {
+      msg_rsv_ = frame_.rsv();
       if(frame_.is_text())
       {
         msg_type_ = TEXT;
+        utf8_.reset();
       }
       else if(frame_.is_binary())
       {
@@ -365,9 +561,11 @@ namespace ws
       }
     }
 
-    void build_write_buffer(detail::Message& out, bool fin, detail::opcode code, size_t payload_size, const Buffer& buf)
+    void build_write_buffer(detail::Message& out, bool fin, detail::opcode code, size_t payload_size, const Buffer& buf,
+                            uint8_t rsv = 0)
     {
       detail::WsFrame f{};
+      f.set_rsv(rsv);
       if(fin)
       {
         f.set_fin();
@@ -376,14 +574,24 @@ namespace ws
       {
         f.unset_fin();
       }
-      f.set_mask(mask_);
+      f.set_mask(this->is_mask_set());
       f.set_code(code);
       f.set_payload_size(payload_size);
-      out.make_space(kMaxFrameSize);
+      out.make_space(kMaxFrameSize + buf.readable_size());
       auto n = f.build(out.begin_write());
       out.write(n);
+      if(!Role::is_fixed || Role::mask_outbound)
+      {
+        if(f.is_mask_set())
+        {
+          // mask while copying, payload is touched only once
+          detail::mask_copy(out.begin_write(), buf.peek(), buf.readable_size(), f.mask_key());
+          out.write(buf.readable_size());
+          return;
+        }
+      }
+      // a server frame is a header followed by the payload as is
       out.append(buf.peek(), buf.readable_size());
-      mask(out.begin_write() - buf.readable_size(), buf.readable_size(), f);
     }
 
     std::string handle_ctrl_msg(const Buffer& v)
@@ -424,131 +632,366 @@ namespace ws
         payload_size = 0x7b;
       }
       char data[0x7d];
-      ctrl_.reset();
       auto r = detail::build_close_msg(data, c, msg.peek(), payload_size);
-      build_write_buffer(ctrl_, true, detail::opcode::close, r, {data, r});
+      // after everything queued, nothing is queued after it since the stream is no longer open. a reply to the
+      // peer's close closes the connection once it's written
+      queue_.push_back(Outbound{this->spare(), {}, {}, 0, {}, true, true});
+      build_write_buffer(queue_.back().frames, true, detail::opcode::close, r, {data, r});
+      this->flush();
+      this->drop_deferred();
+    }
 
-      if(status_ == CLOSING_2)
+    void write_ping_pong(const Buffer& payload, detail::opcode c)
+    {
+      if(status_ == OPENED)
       {
-        std::error_code ec{};
-        asio::write(socket_, asio::buffer(ctrl_.peek(), ctrl_.readable_size()), ec);
-        force_close();
+        auto payload_size = payload.readable_size() > 0x7d ? 0x7d : payload.readable_size();
+        // ahead of the messages waiting, behind the control frames waiting
+        auto it = queue_.begin() + static_cast<std::ptrdiff_t>(std::min(in_flight_, queue_.size()));
+        while(it != queue_.end() && it->control)
+        {
+          ++it;
+        }
+        it = queue_.insert(it, Outbound{this->spare(), {}, {}, 0, {}, true, false});
+        build_write_buffer(it->frames, true, c, payload_size, {payload.peek(), payload_size});
+        this->flush();
       }
-      else
+    }
+
+    // a message at the back of queue_ for its frames to be added to, nullptr when nothing can be written and `cb`
+    // got the error. `bytes` is what `cb` is told once it's written
+    Outbound* push(size_t bytes, SendCallback& cb)
+    {
+      if(!this->writable(cb))
       {
-        ctrl_.set_close();
-        this->write_control_message();
+        return nullptr;
       }
+      queue_.push_back(Outbound{this->spare(), {}, {}, bytes, std::move(cb), false, false});
+      return &queue_.back();
     }
 
-    void write_ping_pong(const Buffer& payload, detail::opcode c)
+    // false when nothing can be written anymore, `cb` got the error
+    bool writable(SendCallback& cb)
     {
-      if(status_ == OPENED)
+      if(status_ != OPENED)
       {
-        auto payload_size = payload.readable_size() > 0x7d ? 0x7d : payload.readable_size();
-        build_write_buffer(ctrl_, true, c, payload_size, {payload.peek(), payload_size});
-        this->write_control_message();
+        cb(make_error_code(ws_error::already_closed), 0);
+        return false;
+      }
+      if(last_error_)
+      {
+        cb(last_error_, 0);
+        return false;
+      }
+      return true;
+    }
+
+    detail::Message spare()
+    {
+      if(spare_.empty())
+      {
+        return detail::Message{};
       }
+      auto m = std::move(spare_.back());
+      spare_.pop_back();
+      return m;
     }
 
-    void write_control_message()
+    // everything queued goes out in a single gathered write, up to a close frame. what's queued meanwhile waits for
+    // its completion, nothing is written twice or out of order
+    void flush()
     {
-      if(ctrl_.readable_size() == 0)
+      if(sending_ || queue_.empty() || last_error_)
       {
         return;
       }
-      if(!sending_)
+      iov_.clear();
+      for(auto& o: queue_)
       {
-        sending_ = true;
-        auto buf = buffer(ctrl_.peek(), ctrl_.readable_size());
-        auto self = shared_from_this();
-        this->write_impl(buf, [self, this](const std::error_code& ec, size_t nbytes) {
-          sending_ = false;
-          if(ec)
-          {
-            last_error_ = ec;
-            return;
-          }
-          ctrl_.read(nbytes);
-          if(ctrl_.is_close())
-          {
-            status_ = CLOSING_2;
-            wrapper_.shutdown_wr();
-            std::error_code e{};
-            timer_.cancel(e);
-            read_impl([self, this](const std::error_code& ec, const Buffer&) {
-              if(ec)
-              {
-                last_error_ = ec;
-              }
-            });
-            wr_buf_.reset();
-          }
-        });
+        if(o.iov.empty())
+        {
+          iov_.emplace_back(o.frames.peek(), o.frames.readable_size());
+        }
+        else
+        {
+          iov_.insert(iov_.end(), o.iov.begin(), o.iov.end());
+        }
+        in_flight_ += 1;
+        if(o.close)
+        {
+          break;
+        }
+      }
+
+      sending_ = true;
+      auto self = shared_from_this();
+      asio::async_write(socket_, iov_, [self, this](const std::error_code& ec, size_t) { this->on_written(ec); });
+    }
+
+    // every entry written is done with in order, after a failure those still queued can't be written either
+    void on_written(const std::error_code& ec)
+    {
+      if(ec)
+      {
+        last_error_ = ec;
+        in_flight_ = queue_.size();
+      }
+      // writes issued from the callbacks are queued since sending_ is still set, in_flight_ counts only the entries
+      // left when one is called
+      while(in_flight_ > 0)
+      {
+        auto o = std::move(queue_.front());
+        queue_.pop_front();
+        in_flight_ -= 1;
+        if(o.close && status_ == CLOSING_2)
+        {
+          this->force_close();
+        }
+        else if(o.close && !ec)
+        {
+          this->on_close_sent();
+        }
+        if(o.cb)
+        {
+          o.cb(ec, ec ? 0 : o.bytes);
+        }
+        if(spare_.size() < kMaxSpare && o.frames.size() <= kMaxMsgSize)
+        {
+          o.frames.reset();
+          spare_.push_back(std::move(o.frames));
+        }
       }
+      if(ec)
+      {
+        this->drop_deferred();
+      }
+      sending_ = false;
+      this->flush();
     }
 
-    void prepare_write(const Buffer& payload, detail::opcode code, SendCallback cb)
+    void on_close_sent()
     {
+      status_ = CLOSING_2;
+      wrapper_.shutdown_wr();
+      std::error_code e{};
+      timer_.cancel(e);
+      auto self = shared_from_this();
+      read_impl([self, this](const std::error_code& ec, const Buffer&) {
+        if(ec)
+        {
+          last_error_ = ec;
+        }
+      });
+    }
+
+    // `hold` owns `payload` when the caller doesn't
+    void prepare_write(const Buffer& payload, detail::opcode code, SendCallback cb,
+                       std::shared_ptr<const void> hold = {})
+    {
+      if(!this->writable(cb))
+      {
+        return;
+      }
       if(payload.readable_size() > max_msg_size_)
       {
         cb(make_error_code(ws_error::payload_too_big), 0);
         return;
       }
 
-      wr_buf_.set_bytes(payload.readable_size());
-      while(payload.readable_size())
+      if(encoding_ || streaming_)
       {
-        size_t payload_size = payload.readable_size();
-        bool fin = true;
-        if(payload_size > fragment_size_)
+        // queued behind the message being encoded or streamed, `payload` is only valid during this call
+        auto data = std::make_shared<const std::string>(payload.peek(), payload.readable_size());
+        deferred_.emplace_back([this, data, code, cb] { this->prepare_write(buffer(*data), code, cb, data); });
+        return;
+      }
+      if(!exts_.empty() && exts_.is_parallel(payload.readable_size()))
+      {
+        this->encode_async(payload, code, cb);
+        return;
+      }
+
+      // extensions see the whole message, the rsv bits they return go on the first frame only
+      uint8_t rsv = 0;
+      Buffer data = exts_.empty() ? payload : exts_.encode(code, payload, ext_out_, rsv);
+      if(auto o = this->push(payload.readable_size(), cb))
+      {
+        // an encoded message is in ext_out_, which the next one reuses
+        this->add_frames(*o, data, code, rsv, true, fragment_size_, rsv == 0 && (hold || write_in_place_));
+        o->hold = std::move(hold);
+        this->flush();
+      }
+    }
+
+    // `data` cut into frames of at most `fragment` bytes, the last one gets `fin`. an unmasked frame is its header
+    // followed by the payload as is, so with `in_place` only headers are built and gathered with `data`, which must
+    // outlive the write
+    void add_frames(Outbound& o, const Buffer& data, detail::opcode code, uint8_t rsv, bool fin, size_t fragment,
+                    bool in_place)
+    {
+      in_place = in_place && !this->is_mask_set();
+      auto n = data.readable_size();
+      size_t frames = n == 0 ? 1 : (n - 1) / fragment + 1;
+      o.frames.make_space(frames * kMaxFrameSize + (in_place ? 0 : n));
+      size_t off = 0;
+      do
+      {
+        auto len = std::min(n - off, fragment);
+        auto part = buffer(data.peek() + off, len);
+        bool last = off + len == n;
+        if(!in_place)
+        {
+          build_write_buffer(o.frames, fin && last, code, len, part, rsv);
+        }
+        else
         {
-          fin = false;
-          payload_size = fragment_size_;
+          detail::WsFrame f{};
+          f.set_rsv(rsv);
+          if(fin && last)
+          {
+            f.set_fin();
+          }
+          f.set_mask(false);
+          f.set_code(code);
+          f.set_payload_size(len);
+          // room for every header was made above, they don't move
+          auto hdr = o.frames.begin_write();
+          auto size = f.build(hdr);
+          o.frames.write(size);
+          o.iov.emplace_back(hdr, size);
+          if(len != 0)
+          {
+            o.iov.emplace_back(part.peek(), len);
+          }
         }
-        wr_buf_.make_space(fragment_size_ + kMaxFrameSize);
-        build_write_buffer(wr_buf_, fin, code, payload_size, {payload.peek(), payload_size});
-        payload.read(payload_size);
+        off += len;
         code = detail::opcode::cont;
+        rsv = 0;
+      } while(off < n);
+    }
+
+    // the extension encodes a copy of the message on another thread, writes issued meanwhile wait in deferred_
+    void encode_async(const Buffer& payload, detail::opcode code, SendCallback cb)
+    {
+      encoding_ = true;
+      auto in = std::make_shared<const std::string>(payload.peek(), payload.readable_size());
+      auto self = shared_from_this();
+      auto ioc = &wrapper_.context();
+      // keeps run() from returning while nothing else is pending
+      auto work = asio::make_work_guard(*ioc);
+      exts_.encode_async(
+          code, in, [self, this, ioc, in, code, cb, work](uint8_t rsv, std::shared_ptr<detail::Message> out) {
+            asio::post(*ioc, [self, this, in, code, cb, work, rsv, out]() mutable {
+              encoding_ = false;
+              rsv = exts_.encoded_async(rsv, out.get());
+              if(auto o = this->push(in->size(), cb))
+              {
+                auto data = rsv != 0 ? buffer(out->peek(), out->readable_size()) : buffer(*in);
+                this->add_frames(*o, data, code, rsv, true, fragment_size_, true);
+                o->hold = rsv != 0 ? std::shared_ptr<const void>{out} : std::shared_ptr<const void>{in};
+                this->flush();
+              }
+              this->run_deferred();
+            });
+          });
+    }
+
+    // writes held back in their order, those which still have to wait go back in line
+    void run_deferred()
+    {
+      auto q = std::move(deferred_);
+      deferred_.clear();
+      while(!q.empty())
+      {
+        if(encoding_)
+        {
+          deferred_.splice(deferred_.begin(), q);
+          return;
+        }
+        auto f = std::move(q.front());
+        q.pop_front();
+        f();
       }
-      write_message(cb);
     }
 
-    void write_message(SendCallback cb)
+    // once the stream can't write anymore a message from begin_message won't end, what waits in deferred_ fails
+    // with the error
+    void drop_deferred()
     {
-      if(status_ != OPENED)
+      streaming_ = false;
+      this->run_deferred();
+    }
+
+    void start_message(bool binary)
+    {
+      if(encoding_)
       {
-        cb(make_error_code(ws_error::already_closed), 0);
+        deferred_.emplace_back([this, binary] { this->start_message(binary); });
         return;
       }
+      if(status_ == OPENED)
+      {
+        streaming_ = true;
+        chunk_code_ = binary ? detail::opcode::binary : detail::opcode::text;
+      }
+    }
 
-      if(last_error_)
+    void write_chunk(const Buffer& buf, bool fin, SendCallback cb)
+    {
+      if(!message_open_)
       {
-        cb(last_error_, 0);
+        cb(make_error_code(ws_error::no_message), 0);
         return;
       }
+      message_open_ = !fin;
+      this->write_frame(buf, fin, cb);
+    }
 
-      if(sending_)
+    // a chunk of the message from begin_message as a frame of its own
+    void write_frame(const Buffer& buf, bool fin, SendCallback cb, std::shared_ptr<const void> hold = {})
+    {
+      if(!this->writable(cb))
       {
-        auto self = shared_from_this();
-        wrapper_.context().post([self, this, cb = std::move(cb)] { write_message(cb); });
         return;
       }
-
-      if(wr_buf_.readable_size() == 0)
+      if(encoding_)
       {
+        auto data = std::make_shared<const std::string>(buf.peek(), buf.readable_size());
+        deferred_.emplace_back([this, data, fin, cb] { this->write_frame(buffer(*data), fin, cb, data); });
         return;
       }
+      auto code = chunk_code_;
+      chunk_code_ = detail::opcode::cont;
+      if(auto o = this->push(buf.readable_size(), cb))
+      {
+        // a chunk is a single frame
+        this->add_frames(*o, buf, code, 0, fin, buf.readable_size(), hold || write_in_place_);
+        o->hold = std::move(hold);
+        this->flush();
+      }
+      if(fin)
+      {
+        // the writes waiting are queued behind the last frame
+        streaming_ = false;
+        this->run_deferred();
+      }
+    }
 
-      sending_ = true;
-      auto buf = buffer(wr_buf_.peek(), wr_buf_.readable_size());
-      auto self = shared_from_this();
-      this->write_impl(buf, [self, this, cb = std::move(cb)](const std::error_code& ec, size_t) {
-        sending_ = false;
-        cb(ec, wr_buf_.bytes());
-        wr_buf_.reset();
-        this->write_control_message();
-      });
+    // nullptr when the extensions in use can't share an encoding
+    const prepared_message::Encoding* prepared_encoding(const prepared_message& msg)
+    {
+      if(!exts_.encoding_key(ext_key_))
+      {
+        return nullptr;
+      }
+      auto e = msg.find(ext_key_);
+      if(e == nullptr)
+      {
+        uint8_t rsv = 0;
+        auto data = exts_.encode(msg.code(), msg.payload(), ext_out_, rsv);
+        e = msg.add(ext_key_, data, rsv);
+      }
+      return e;
     }
 
     void handshake_impl(HandshakeCallback cb)
@@ -576,6 +1019,10 @@ namespace ws
               this->handshake_impl(cb);
             }
           }
+          else if(http::header_error::ok == r && (r = this->confirm_extensions()) != http::header_error::ok)
+          {
+            cb(http::make_error_code(r));
+          }
           else if(http::header_error::ok == r)
           {
             rd_buf_.read(header_.size());
@@ -592,11 +1039,79 @@ namespace ws
       });
     }
 
+    // client, subprotocols and extensions of the upgrade request, header_ keeps views of hs_protocols_ and hs_extra_
+    void offer_extensions()
+    {
+      hs_protocols_.clear();
+      for(auto& p: protocols_)
+      {
+        if(!hs_protocols_.empty())
+        {
+          hs_protocols_.append(", ");
+        }
+        hs_protocols_.append(p);
+      }
+      if(!hs_protocols_.empty())
+      {
+        header_.set("sec-websocket-protocol", hs_protocols_);
+      }
+      hs_extra_ = exts_.offer();
+      if(!hs_extra_.empty())
+      {
+        header_.set("sec-websocket-extensions", hs_extra_);
+      }
+    }
+
+    // client, the server may only pick what we offered
+    http::header_error confirm_extensions()
+    {
+      protocol_.clear();
+      auto p = header_.field("sec-websocket-protocol");
+      if(!p.empty())
+      {
+        if(detail::select_subprotocol(p, protocols_).size() != p.size())
+        {
+          return http::header_error::invalid_sec_ws_protocol;
+        }
+        protocol_ = p.to_string();
+      }
+      if(!exts_.confirm(header_.field("sec-websocket-extensions")))
+      {
+        exts_.reset();
+        return http::header_error::invalid_sec_ws_ext;
+      }
+      return http::header_error::ok;
+    }
+
+    // server, the subprotocol picked from the client offers goes to protocol_, the Sec-WebSocket-Extensions value
+    // for the extensions accepted to `ext`. a malformed extension offer is ignored as a whole
+    void accept_extensions(std::string& ext)
+    {
+      auto p = detail::select_subprotocol(header_.field("sec-websocket-protocol"), protocols_);
+      protocol_.assign(p.data(), p.size());
+      if(!exts_.accept(header_.field("sec-websocket-extensions"), ext))
+      {
+        exts_.reset();
+        ext.clear();
+      }
+    }
+
+    // the 101 response is written in place, the accept key never leaves the stack. it allocates only for a
+    // negotiated extension or a subprotocol name too long for protocol_ to keep inline
+    void write_accept_header()
+    {
+      std::string ext;
+      this->accept_extensions(ext);
+      wr_buf_.make_space(http::header::accept_header_size(protocol_, ext));
+      wr_buf_.write(http::header::build_accept_header(header_, wr_buf_.begin_write(), protocol_, ext));
+    }
+
     void accept_impl(AcceptCallback cb)
     {
       auto b = asio::buffer(rd_buf_.peek() + rd_buf_.readable_size(), rd_buf_.writable_size());
       auto self = shared_from_this();
-      socket_.async_read_some(b, [cb = std::move(cb), self, this](const std::error_code& ec, size_t nbytes) {
+      // mutable, so `cb` moves on instead of being copied
+      socket_.async_read_some(b, [cb = std::move(cb), self, this](const std::error_code& ec, size_t nbytes) mutable {
         rd_buf_.write(nbytes);
         if(ec)
         {
@@ -613,7 +1128,7 @@ namespace ws
             }
             else
             {
-              this->accept_impl(cb);
+              this->accept_impl(std::move(cb));
             }
             return;
           }
@@ -624,8 +1139,7 @@ namespace ws
             return;
           }
 
-          auto tmp = http::header::build_accept_header(header_);
-          wr_buf_.append(tmp.data(), tmp.size());
+          this->write_accept_header();
           rd_buf_.read(header_.size());
           auto buf = buffer(wr_buf_.peek(), wr_buf_.readable_size());
           this->write_impl(buf, [cb = std::move(cb), self, this](const std::error_code& ec, size_t) {
@@ -657,38 +1171,73 @@ namespace ws
           cb(last_error_, {});
           return;
         }
-        auto e = frame_.parse_frame(rd_buf_.peek(), rd_buf_.readable_size());
-        if(e)
+        if(index_.empty())
         {
-          cb(e, {});
-          return;
+          // the rest of a frame read_some stopped in is dropped
+          auto skip = std::min<uint64_t>(chunk_left_, rd_buf_.readable_size());
+          rd_buf_.read(skip);
+          chunk_left_ -= skip;
+          index_base_ = rd_buf_.consumed();
+          auto e = index_.build(rd_buf_.peek(), rd_buf_.readable_size(), exts_.rsv_bits());
+          if(index_.empty())
+          {
+            if(e)
+            {
+              cb(e, {});
+              return;
+            }
+
+            // only a partial frame is buffered, reject it as soon as its header says it's too big
+            frame_.parse_frame(rd_buf_.peek(), rd_buf_.readable_size(), exts_.rsv_bits());
+            if(frame_.is_complete() && payload_.readable_size() + frame_.payload_size() > max_message_size())
+            {
+              cb(make_error_code(ws_error::payload_too_big), {});
+              return;
+            }
+
+            rd_buf_.make_space(fragment_size_ + kMaxFrameSize);
+            auto buf = asio::buffer(rd_buf_.begin_write(), rd_buf_.writable_size());
+            auto self = shared_from_this();
+            socket_.async_read_some(buf, [cb, self, this](const std::error_code& ec, size_t nbytes) {
+              if(ec)
+              {
+                cb(ec, {});
+              }
+              else
+              {
+                rd_buf_.write(nbytes);
+                this->read_impl(cb);
+              }
+            });
+            return;
+          }
         }
 
-        if(frame_.is_complete())
+        auto& desc = index_.front();
+        assert(index_base_ + desc.offset == rd_buf_.consumed());
+        frame_.assign(desc);
+        index_.pop();
+
+        if constexpr(Role::is_fixed)
         {
-          if(payload_.readable_size() + frame_.payload_size() > max_message_size())
+          // RFC 6455 5.1, clients mask every frame, servers never do
+          if(desc.mask != Role::mask_inbound)
           {
-            cb(make_error_code(ws_error::payload_too_big), {});
+            cb(make_error_code(Role::mask_inbound ? ws_error::unmasked_frame : ws_error::masked_frame), {});
             return;
           }
         }
 
-        if(!frame_.is_complete() || rd_buf_.readable_size() < frame_.size())
+        if(payload_.readable_size() + frame_.payload_size() > max_message_size())
         {
-          rd_buf_.make_space(fragment_size_ + kMaxFrameSize);
-          auto buf = asio::buffer(rd_buf_.begin_write(), rd_buf_.writable_size());
-          auto self = shared_from_this();
-          socket_.async_read_some(buf, [cb, self, this](const std::error_code& ec, size_t nbytes) {
-            if(ec)
-            {
-              cb(ec, {});
-            }
-            else
-            {
-              rd_buf_.write(nbytes);
-              this->read_impl(cb);
-            }
-          });
+          cb(make_error_code(ws_error::payload_too_big), {});
+          return;
+        }
+
+        // extension bits belong to the first frame of a message
+        if(frame_.rsv() != 0 && frame_.code() == detail::opcode::cont)
+        {
+          cb(make_error_code(ws_error::bad_frame), {});
           return;
         }
 
@@ -701,9 +1250,19 @@ namespace ws
 
         rd_buf_.read(frame_.frame_size());
 
-        this->mask(rd_buf_.peek(), frame_.payload_size(), frame_);
-        auto b = buffer(rd_buf_.peek(), frame_.payload_size());
+        if(!frame_.is_control() && frame_.code() != detail::opcode::cont)
+        {
+          set_msg_type();
+        }
+        // consume the frame first, reading goes on after a bad fragment until the close reply
+        auto data = rd_buf_.peek();
         rd_buf_.read(frame_.payload_size());
+        if(!this->unmask_payload(data, frame_.payload_size()))
+        {
+          cb(this->bad_payload(), {});
+          return;
+        }
+        auto b = buffer(data, frame_.payload_size());
         if(frame_.is_control())
         {
           auto r = handle_ctrl_msg(b);
@@ -719,172 +1278,400 @@ namespace ws
         }
         else
         {
-          payload_.append(b.peek(), b.readable_size());
-          if(frame_.is_fin())
+          // a message in a single frame is handed out where it is in rd_buf_, only fragments are gathered
+          if(!frame_.is_fin() || payload_.readable_size() != 0)
           {
-            set_msg_type();
+            payload_.append(b.peek(), b.readable_size());
             b = buffer(payload_.peek(), payload_.readable_size());
-            cb({}, b);
+          }
+          if(frame_.is_fin())
+          {
+            auto e = msg_rsv_ != 0 ? this->decode_message(b) : std::error_code{};
+            if(e)
+            {
+              cb(e, {});
+              return;
+            }
+            // b stays readable, reset first so a read issued from cb starts a new message
             payload_.reset();
+            cb({}, b);
             return;
           }
         }
         frame_.clear();
       }
     }
+
+    // frames are parsed in place rather than indexed, a data frame is handed out as far as it's buffered and its
+    // header is all that's kept of it
+    void read_some_impl(ChunkCallback cb)
+    {
+      auto more = [&cb, this] {
+        rd_buf_.make_space(fragment_size_ + kMaxFrameSize);
+        auto buf = asio::buffer(rd_buf_.begin_write(), rd_buf_.writable_size());
+        auto self = shared_from_this();
+        socket_.async_read_some(buf, [cb, self, this](const std::error_code& ec, size_t nbytes) {
+          if(ec)
+          {
+            cb(ec, {}, {});
+          }
+          else
+          {
+            rd_buf_.write(nbytes);
+            this->read_some_impl(cb);
+          }
+        });
+      };
+
+      for(; status_ == OPENED || status_ == CLOSING_2;)
+      {
+        if(last_error_)
+        {
+          cb(last_error_, {}, {});
+          return;
+        }
+        if(chunk_left_ == 0)
+        {
+          // frames indexed by read are parsed again
+          index_.clear();
+          auto e = frame_.parse_frame(rd_buf_.peek(), rd_buf_.readable_size(), exts_.rsv_bits());
+          if(e)
+          {
+            cb(e, {}, {});
+            return;
+          }
+          // a control frame is handled whole, it's at most 125 bytes
+          if(!frame_.is_complete() || (frame_.is_control() && rd_buf_.readable_size() < frame_.size()))
+          {
+            more();
+            return;
+          }
+
+          if constexpr(Role::is_fixed)
+          {
+            if(frame_.is_mask_set() != Role::mask_inbound)
+            {
+              cb(make_error_code(Role::mask_inbound ? ws_error::unmasked_frame : ws_error::masked_frame), {}, {});
+              return;
+            }
+          }
+          if(frame_.rsv() != 0 && frame_.code() == detail::opcode::cont)
+          {
+            cb(make_error_code(ws_error::bad_frame), {}, {});
+            return;
+          }
+          if(status_ == CLOSING_2 && !frame_.is_close())
+          {
+            cb(make_error_code(ws_error::expect_close), {}, {});
+            return;
+          }
+
+          rd_buf_.read(frame_.frame_size());
+          if(frame_.is_control())
+          {
+            auto data = rd_buf_.peek();
+            rd_buf_.read(frame_.payload_size());
+            this->unmask_payload(data, frame_.payload_size());
+            auto r = handle_ctrl_msg(buffer(data, frame_.payload_size()));
+            if(frame_.is_close())
+            {
+              cb(make_error_code(ws_error::closed), buffer(r), {});
+              return;
+            }
+            continue;
+          }
+          if(frame_.code() != detail::opcode::cont)
+          {
+            set_msg_type();
+            chunk_first_ = true;
+          }
+          chunk_left_ = frame_.payload_size();
+          chunk_offset_ = 0;
+        }
+
+        auto n = static_cast<size_t>(std::min<uint64_t>(chunk_left_, rd_buf_.readable_size()));
+        if(n == 0 && chunk_left_ != 0)
+        {
+          more();
+          return;
+        }
+        auto data = rd_buf_.peek();
+        auto offset = chunk_offset_;
+        rd_buf_.read(n);
+        chunk_left_ -= n;
+        chunk_offset_ += n;
+        bool end = chunk_left_ == 0;
+        if(!this->unmask_payload(data, n, offset, end))
+        {
+          cb(this->bad_payload(), {}, {});
+          return;
+        }
+
+        message_chunk c{chunk_first_, end && frame_.is_fin(),
+                        msg_type_ == BINARY ? detail::opcode::binary : detail::opcode::text};
+        if(msg_rsv_ != 0)
+        {
+          // extensions decode whole messages
+          if(payload_.readable_size() + n > max_message_size())
+          {
+            cb(make_error_code(ws_error::payload_too_big), {}, {});
+            return;
+          }
+          payload_.append(data, n);
+          if(!c.last)
+          {
+            continue;
+          }
+          auto b = buffer(payload_.peek(), payload_.readable_size());
+          auto e = this->decode_message(b);
+          if(e)
+          {
+            cb(e, {}, {});
+            return;
+          }
+          payload_.reset();
+          chunk_first_ = false;
+          cb({}, b, {true, true, c.code});
+          return;
+        }
+        // nothing to say about an empty frame inside a message
+        if(n == 0 && !c.first && !c.last)
+        {
+          continue;
+        }
+        chunk_first_ = false;
+        cb({}, buffer(data, n), c);
+        return;
+      }
+    }
   };
 
-  template<typename NextLayer>
+  template<typename NextLayer, typename Role>
   template<typename... Args>
-  stream<NextLayer>::stream(Args&&... args) : layer_{}
+  stream<NextLayer, Role>::stream(Args&&... args) : layer_{}
   {
     layer_ = impl::create(std::forward<Args>(args)...);
   }
 
-  template<typename NextLayer>
-  stream<NextLayer>::stream(stream&& rhs) noexcept : layer_{std::move(rhs.layer_)}
+  template<typename NextLayer, typename Role>
+  stream<NextLayer, Role>::stream(stream&& rhs) noexcept : layer_{std::move(rhs.layer_)}
   {
   }
 
-  template<typename NextLayer>
-  stream<NextLayer>& stream<NextLayer>::operator=(stream&& rhs) noexcept
+  template<typename NextLayer, typename Role>
+  stream<NextLayer, Role>& stream<NextLayer, Role>::operator=(stream&& rhs) noexcept
   {
     if(this != &rhs)
     {
       this->~stream();
-      new(this) stream<NextLayer>{std::move(rhs)};
+      new(this) stream<NextLayer, Role>{std::move(rhs)};
     }
     return *this;
   }
 
-  template<typename NextLayer>
-  void stream<NextLayer>::set_ping_msg(const std::string& msg, const std::chrono::seconds& interval)
+  template<typename NextLayer, typename Role>
+  void stream<NextLayer, Role>::set_ping_msg(const std::string& msg, const std::chrono::seconds& interval)
   {
     layer_->set_ping_msg(msg, interval);
   }
 
-  template<typename NextLayer>
-  bool stream<NextLayer>::is_bin()
+  template<typename NextLayer, typename Role>
+  bool stream<NextLayer, Role>::is_bin()
   {
     return layer_->is_bin();
   }
 
-  template<typename NextLayer>
-  bool stream<NextLayer>::is_text()
+  template<typename NextLayer, typename Role>
+  bool stream<NextLayer, Role>::is_text()
   {
     return layer_->is_text();
   }
 
-  template<typename NextLayer>
-  bool stream<NextLayer>::is_open()
+  template<typename NextLayer, typename Role>
+  bool stream<NextLayer, Role>::is_open()
   {
     return layer_->is_open();
   }
 
-  template<typename NextLayer>
-  void stream<NextLayer>::set_fragment_size(size_t n)
+  template<typename NextLayer, typename Role>
+  void stream<NextLayer, Role>::add_extension(std::shared_ptr<extension> ext)
+  {
+    layer_->add_extension(std::move(ext));
+  }
+
+  template<typename NextLayer, typename Role>
+  void stream<NextLayer, Role>::set_subprotocols(std::vector<std::string> protocols)
+  {
+    layer_->set_subprotocols(std::move(protocols));
+  }
+
+  template<typename NextLayer, typename Role>
+  const std::string& stream<NextLayer, Role>::subprotocol()
+  {
+    return layer_->subprotocol();
+  }
+
+  template<typename NextLayer, typename Role>
+  void stream<NextLayer, Role>::set_fragment_size(size_t n)
   {
     layer_->set_fragment_size(n);
   }
 
-  template<typename NextLayer>
-  void stream<NextLayer>::set_max_message_size(size_t n)
+  template<typename NextLayer, typename Role>
+  void stream<NextLayer, Role>::set_max_message_size(size_t n)
   {
     layer_->set_max_message_size(n);
   }
 
-  template<typename NextLayer>
-  size_t stream<NextLayer>::fragment_size()
+  template<typename NextLayer, typename Role>
+  size_t stream<NextLayer, Role>::fragment_size()
   {
     return layer_->fragment_size();
   }
 
-  template<typename NextLayer>
-  size_t stream<NextLayer>::max_message_size()
+  template<typename NextLayer, typename Role>
+  size_t stream<NextLayer, Role>::max_message_size()
   {
     return layer_->max_message_size();
   }
 
-  template<typename NextLayer>
-  void stream<NextLayer>::set_mask(bool on)
+  template<typename NextLayer, typename Role>
+  void stream<NextLayer, Role>::set_mask(bool on)
   {
     layer_->set_mask(on);
   }
 
-  template<typename NextLayer>
-  bool stream<NextLayer>::is_mask_set()
+  template<typename NextLayer, typename Role>
+  bool stream<NextLayer, Role>::is_mask_set()
   {
     return layer_->is_mask_set();
   }
 
-  template<typename NextLayer>
-  std::error_code stream<NextLayer>::last_error()
+  template<typename NextLayer, typename Role>
+  void stream<NextLayer, Role>::set_validate_utf8(bool on)
+  {
+    layer_->set_validate_utf8(on);
+  }
+
+  template<typename NextLayer, typename Role>
+  bool stream<NextLayer, Role>::is_validate_utf8_set()
+  {
+    return layer_->is_validate_utf8_set();
+  }
+
+  template<typename NextLayer, typename Role>
+  void stream<NextLayer, Role>::set_write_in_place(bool on)
+  {
+    layer_->set_write_in_place(on);
+  }
+
+  template<typename NextLayer, typename Role>
+  bool stream<NextLayer, Role>::is_write_in_place_set()
+  {
+    return layer_->is_write_in_place_set();
+  }
+
+  template<typename NextLayer, typename Role>
+  std::error_code stream<NextLayer, Role>::last_error()
   {
     return layer_->last_error();
   }
 
-  template<typename NextLayer>
-  NextLayer& stream<NextLayer>::next_layer()
+  template<typename NextLayer, typename Role>
+  NextLayer& stream<NextLayer, Role>::next_layer()
   {
     return layer_->next_layer();
   }
 
-  template<typename NextLayer>
-  typename NextLayer::lowest_layer_type& stream<NextLayer>::lowest_layer()
+  template<typename NextLayer, typename Role>
+  typename NextLayer::lowest_layer_type& stream<NextLayer, Role>::lowest_layer()
   {
     return layer_->next_layer().lowest_layer();
   }
 
-  template<typename NextLayer>
-  void stream<NextLayer>::handshake(const nm::string_view& h, const nm::string_view& p, HandshakeCallback cb)
+  template<typename NextLayer, typename Role>
+  void stream<NextLayer, Role>::handshake(const nm::string_view& h, const nm::string_view& p, HandshakeCallback cb)
   {
+    static_assert(!std::is_same<Role, role::server>::value, "a server stream accepts, it can't handshake");
     layer_->handshake(h, p, cb);
   }
 
-  template<typename NextLayer>
-  void stream<NextLayer>::accept(AcceptCallback cb)
+  template<typename NextLayer, typename Role>
+  void stream<NextLayer, Role>::accept(AcceptCallback cb)
   {
-    layer_->accept(cb);
+    static_assert(!std::is_same<Role, role::client>::value, "a client stream handshakes, it can't accept");
+    layer_->accept(std::move(cb));
   }
 
-  template<typename NextLayer>
-  void stream<NextLayer>::accept(const Buffer& data, AcceptCallback cb)
+  template<typename NextLayer, typename Role>
+  void stream<NextLayer, Role>::accept(const Buffer& data, AcceptCallback cb)
   {
-    layer_->accept(data, cb);
+    static_assert(!std::is_same<Role, role::client>::value, "a client stream handshakes, it can't accept");
+    layer_->accept(data, std::move(cb));
   }
 
-  template<typename NextLayer>
-  void stream<NextLayer>::close(close_code c, const Buffer& msg)
+  template<typename NextLayer, typename Role>
+  void stream<NextLayer, Role>::close(close_code c, const Buffer& msg)
   {
     layer_->close(c, msg);
   }
 
-  template<typename NextLayer>
-  void stream<NextLayer>::force_close()
+  template<typename NextLayer, typename Role>
+  void stream<NextLayer, Role>::force_close()
   {
     layer_->force_close();
   }
 
-  template<typename NextLayer>
-  void stream<NextLayer>::read(RecvCallback cb)
+  template<typename NextLayer, typename Role>
+  void stream<NextLayer, Role>::read(RecvCallback cb)
   {
     layer_->read(cb);
   }
 
-  template<typename NextLayer>
-  void stream<NextLayer>::write_text(const Buffer& buf, SendCallback cb)
+  template<typename NextLayer, typename Role>
+  void stream<NextLayer, Role>::read_some(ChunkCallback cb)
+  {
+    layer_->read_some(cb);
+  }
+
+  template<typename NextLayer, typename Role>
+  void stream<NextLayer, Role>::write_text(const Buffer& buf, SendCallback cb)
   {
     layer_->write_text(buf, cb);
   }
 
-  template<typename NextLayer>
-  void stream<NextLayer>::write_binary(const Buffer& buf, SendCallback cb)
+  template<typename NextLayer, typename Role>
+  void stream<NextLayer, Role>::write_binary(const Buffer& buf, SendCallback cb)
   {
     layer_->write_binary(buf, cb);
   }
 
-  template<typename NextLayer>
-  asio::io_context& stream<NextLayer>::context()
+  template<typename NextLayer, typename Role>
+  void stream<NextLayer, Role>::write_prepared(std::shared_ptr<const prepared_message> msg, SendCallback cb)
+  {
+    layer_->write_prepared(std::move(msg), cb);
+  }
+
+  template<typename NextLayer, typename Role>
+  std::error_code stream<NextLayer, Role>::begin_message(bool binary)
+  {
+    return layer_->begin_message(binary);
+  }
+
+  template<typename NextLayer, typename Role>
+  void stream<NextLayer, Role>::write_chunk(const Buffer& buf, SendCallback cb)
+  {
+    layer_->write_chunk(buf, cb);
+  }
+
+  template<typename NextLayer, typename Role>
+  void stream<NextLayer, Role>::end_message(const Buffer& buf, SendCallback cb)
+  {
+    layer_->end_message(buf, cb);
+  }
+
+  template<typename NextLayer, typename Role>
+  asio::io_context& stream<NextLayer, Role>::context()
   {
     return layer_->context();
   }
@@ -11,21 +11,33 @@
 #include <algorithm>
 #include <chrono>
 #include <cstdint>
+#include <deque>
 #include <functional>
 #include <list>
-#include <map>
 #include <memory>
+#include <mutex>
 #include <random>
 #include <string>
 #include <system_error>
+#include <vector>
 #include "detail/error.h"
 #include "detail/buffer.h"
 #include "detail/string_view.h"
+#include "detail/cpu.h"
+#include "detail/utf8.h"
 #include "detail/base64.h"
 #include "detail/sha1.h"
 #include "detail/header.h"
+#include "detail/mask.h"
 #include "detail/frame.h"
-#include "detail/utf8.h"
+#include "detail/extension.h"
+#ifdef WS_WITH_ZLIB
+#include "detail/deflate.h"
+#endif
+#ifdef WS_WITH_ZSTD
+#include "detail/zstd.h"
+#endif
+#include "detail/prepared.h"
 #include "impl/stream.h"
 #include "impl/stream_impl.h"
 